@@ -39,6 +39,7 @@
 #include <vm.h>
 #include <mainbus.h>
 #include <syscall.h>
+#include "opt-A3.h"
 
 
 /* in exception.S */
@@ -114,7 +115,15 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 
 	kprintf("Fatal user mode trap %u sig %d (%s, epc 0x%x, vaddr 0x%x)\n",
 		code, sig, trapcodenames[code], epc, vaddr);
+#if OPT_A3
+	/*
+	 * With real memory protection, touching the wrong page is
+	 * the process's problem, not the kernel's. Kill it.
+	 */
+	sys__exit(sig);
+#else
 	panic("I don't know how to handle this\n");
+#endif
 }
 
 /*
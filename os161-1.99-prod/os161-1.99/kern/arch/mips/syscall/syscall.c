@@ -35,6 +35,8 @@
 #include <thread.h>
 #include <current.h>
 #include <syscall.h>
+#include <addrspace.h>
+#include "opt-dumbvm.h"
 
 
 /*
@@ -123,12 +125,44 @@ syscall(struct trapframe *tf)
 	case SYS_getpid:
 	  err = sys_getpid((pid_t *)&retval);
 	  break;
+	case SYS_fork:
+	  err = sys_fork(tf, (pid_t *)&retval);
+	  break;
+	case SYS_vfork:
+	  err = sys_vfork(tf, (pid_t *)&retval);
+	  break;
 	case SYS_waitpid:
 	  err = sys_waitpid((pid_t)tf->tf_a0,
 			    (userptr_t)tf->tf_a1,
 			    (int)tf->tf_a2,
 			    (pid_t *)&retval);
 	  break;
+#if !OPT_DUMBVM
+	case SYS_sbrk:
+	  err = sys_sbrk((intptr_t)tf->tf_a0,
+			 (vaddr_t *)&retval);
+	  break;
+	case SYS_mmap:
+	  err = sys_mmap((userptr_t)tf->tf_a0,
+			 (size_t)tf->tf_a1,
+			 (int)tf->tf_a2,
+			 (int)tf->tf_a3,
+			 (vaddr_t *)&retval);
+	  break;
+	case SYS_munmap:
+	  err = sys_munmap((userptr_t)tf->tf_a0,
+			   (size_t)tf->tf_a1);
+	  break;
+	case SYS_mprotect:
+	  err = sys_mprotect((userptr_t)tf->tf_a0,
+			     (size_t)tf->tf_a1,
+			     (int)tf->tf_a2);
+	  break;
+	case SYS_faultstat:
+	  err = sys_faultstat((int)tf->tf_a0,
+			      (userptr_t)tf->tf_a1);
+	  break;
+#endif
 #endif // UW
 
 	    /* Add stuff here */
@@ -171,13 +205,24 @@ syscall(struct trapframe *tf)
 /*
  * Enter user mode for a newly forked process.
  *
- * This function is provided as a reminder. You need to write
- * both it and the code that calls it.
- *
- * Thus, you can trash it and do things another way if you prefer.
+ * TF is a kmalloc'd copy of the parent's trapframe from the system
+ * call; it is copied onto our stack and freed. The process returns to
+ * userlevel with a return value of 0.
  */
 void
 enter_forked_process(struct trapframe *tf)
 {
-	(void)tf;
+	struct trapframe mytf;
+
+	mytf = *tf;
+	kfree(tf);
+
+	mytf.tf_v0 = 0;		/* child's return value */
+	mytf.tf_a3 = 0;		/* signal no error */
+	mytf.tf_epc += 4;	/* skip the syscall instruction */
+
+	as_activate();
+
+	mips_usermode(&mytf);
+	panic("enter_forked_process: mips_usermode returned\n");
 }
@@ -91,6 +91,12 @@ free_kpages(vaddr_t addr)
 	(void)addr;
 }
 
+bool
+vm_idle(void)
+{
+	return false;
+}
+
 void
 vm_tlbshootdown_all(void)
 {
@@ -98,9 +104,10 @@ vm_tlbshootdown_all(void)
 }
 
 void
-vm_tlbshootdown(const struct tlbshootdown *ts)
+vm_tlbshootdown(const struct tlbshootdown *ts, int n)
 {
 	(void)ts;
+	(void)n;
 	panic("dumbvm tried to do tlb shootdown?!\n");
 }
 
@@ -0,0 +1,372 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <cpu.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <mips/tlb.h>
+#include <uw-vmstats.h>
+#include <vm.h>
+
+/*
+ * MIPS TLB management for the paged VM system.
+ *
+ * When vm_tlb_load finds no free slot it evicts one, chosen by the
+ * current replacement policy:
+ *
+ *    rr      - round-robin over all slots (the default).
+ *    random  - let the hardware pick, using the Random register.
+ *    nru     - second chance. The hardware has no reference bit, so
+ *              the valid bit stands in for it: the clock hand clears
+ *              TLBLO_VALID on entries it passes (keeping their
+ *              EntryHi), and takes the first entry it finds already
+ *              cleared. A page that is used again before the hand
+ *              comes back faults, gets its slot revalidated by
+ *              vm_tlb_load, and so survives another sweep.
+ *
+ * A slot is free only if it holds TLBHI_INVALID for its index; an
+ * entry demoted by the nru hand still owns its slot.
+ *
+ * The policy is picked with vm_tlb_setpolicy, normally from the boot
+ * command line (see the "tlbp" menu command). The round-robin/clock
+ * hand is shared by all CPUs; races on it only perturb the choice of
+ * victim, never correctness.
+ *
+ * Entries are tagged with the address space id (the PID field of
+ * EntryHi) of the address space they belong to, so switching address
+ * spaces only means loading its id into EntryHi; the other processes'
+ * entries stay in the TLB, but don't match. There are only 63 ids to
+ * go around (0 is never handed out), so they are given out in
+ * generations. An address space keeps its id for as long as the
+ * generation it got it in is current. When the ids run out, a new
+ * generation starts, and every address space gets a new id the next
+ * time it is activated. Each cpu remembers the generation its TLB
+ * holds entries for, and flushes it on first activating anything in
+ * a newer one - that, and not every switch, is when the TLB is
+ * flushed.
+ *
+ * Throwing away an address space's id (vm_tlb_forget) is how all of
+ * its translations are dropped at once: the entries left behind with
+ * the old id can't match anything until that id is reused, which is
+ * after every cpu has flushed.
+ *
+ * For comparison, ids can be turned off (vm_tlb_setasids), which makes
+ * every activation flush the TLB the way it used to.
+ *
+ * An address space also records which cpus have activated it under
+ * its current id, since only their TLBs can have entries that match
+ * it. TLB shootdowns go to those cpus only.
+ *
+ * tlb_write, tlb_read, tlb_probe, and tlb_random all load EntryHi,
+ * so everything here that uses them puts the current id back after.
+ */
+
+#define ASID_COUNT  64		/* 6-bit PID field */
+#define ASID_MKHI(asid)  ((uint32_t)(asid) << TLBHI_PIDSHIFT)
+
+static struct spinlock asid_lock = SPINLOCK_INITIALIZER;
+static uint32_t asid_gen = 1;		/* current generation */
+static unsigned asid_next = 1;		/* next id to hand out in it */
+static unsigned asid_assigned;		/* ids handed out, ever */
+static unsigned asid_flushes;		/* flushes forced by a new generation */
+static bool asid_enabled = true;	/* false: flush on every activation */
+
+static const char *const tlb_policynames[] = {
+	"rr",		/* TLBPOLICY_RR */
+	"random",	/* TLBPOLICY_RANDOM */
+	"nru",		/* TLBPOLICY_NRU */
+};
+
+static int tlb_policy = TLBPOLICY_RR;
+static unsigned tlb_hand;
+
+int
+vm_tlb_setpolicy(const char *name)
+{
+	int i;
+
+	for (i=0; i<TLBPOLICY_COUNT; i++) {
+		if (!strcmp(name, tlb_policynames[i])) {
+			tlb_policy = i;
+			return 0;
+		}
+	}
+	return EINVAL;
+}
+
+const char *
+vm_tlb_policyname(void)
+{
+	return tlb_policynames[tlb_policy];
+}
+
+void
+vm_tlb_setasids(bool on)
+{
+	asid_enabled = on;
+}
+
+bool
+vm_tlb_asids(void)
+{
+	return asid_enabled;
+}
+
+/*
+ * Invalidate every slot. Interrupts are off.
+ */
+static
+void
+tlb_clear(void)
+{
+	uint32_t ehi;
+	int i;
+
+	ehi = tlb_getentryhi();
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+	}
+	tlb_setentryhi(ehi);
+}
+
+void
+vm_tlb_flush(void)
+{
+	int spl;
+
+	/* Disable interrupts on this CPU while frobbing the TLB. */
+	spl = splhigh();
+	tlb_clear();
+	splx(spl);
+
+	vmstats_inc(VMSTAT_TLB_INVALIDATE);
+}
+
+void
+vm_tlb_invalidate(struct addrspace *as, vaddr_t vaddr)
+{
+	uint32_t ehi;
+	int i;
+
+	KASSERT((vaddr & PAGE_FRAME) == vaddr);
+
+	/*
+	 * If AS has no id in the generation this cpu's TLB is in,
+	 * nothing in it can be AS's.
+	 */
+	i = -1;
+	spinlock_acquire(&asid_lock);
+	if (as->as_asidgen != 0 && as->as_asidgen == curcpu->c_asidgen) {
+		ehi = tlb_getentryhi();
+		i = tlb_probe(vaddr | ASID_MKHI(as->as_asid), 0);
+		if (i >= 0) {
+			tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+		}
+		tlb_setentryhi(ehi);
+	}
+	spinlock_release(&asid_lock);
+
+	if (i >= 0) {
+		vmstats_inc(VMSTAT_TLB_INVALIDATE);
+	}
+}
+
+void
+vm_tlb_activate(struct addrspace *as)
+{
+	bool flushed;
+
+	flushed = false;
+
+	/* The spinlock also keeps interrupts off while we're at it. */
+	spinlock_acquire(&asid_lock);
+
+	if (as->as_asidgen != asid_gen) {
+		if (asid_next == ASID_COUNT) {
+			/* Out of ids; start a new generation. */
+			asid_gen++;
+			asid_next = 1;
+			DEBUG(DB_VM, "tlb: asid generation %u\n", asid_gen);
+		}
+		as->as_asid = asid_next++;
+		as->as_asidgen = asid_gen;
+		as->as_cpus = 0;
+		asid_assigned++;
+	}
+	KASSERT(curcpu->c_number < 32);
+	as->as_cpus |= (uint32_t)1 << curcpu->c_number;
+
+	if (curcpu->c_asidgen != asid_gen) {
+		/* Entries from an older generation may reuse this id. */
+		tlb_clear();
+		curcpu->c_asidgen = asid_gen;
+		asid_flushes++;
+		flushed = true;
+	}
+	else if (!asid_enabled) {
+		tlb_clear();
+		flushed = true;
+	}
+
+	tlb_setentryhi(ASID_MKHI(as->as_asid));
+
+	spinlock_release(&asid_lock);
+
+	if (flushed) {
+		vmstats_inc(VMSTAT_TLB_INVALIDATE);
+	}
+}
+
+void
+vm_tlb_forget(struct addrspace *as)
+{
+	spinlock_acquire(&asid_lock);
+	as->as_asidgen = 0;
+	as->as_cpus = 0;
+	spinlock_release(&asid_lock);
+
+	if (as == curproc_getas()) {
+		vm_tlb_activate(as);
+	}
+}
+
+uint32_t
+vm_tlb_cpus(struct addrspace *as)
+{
+	uint32_t cpus;
+
+	spinlock_acquire(&asid_lock);
+	cpus = as->as_asidgen == 0 ? 0 : as->as_cpus;
+	spinlock_release(&asid_lock);
+	return cpus;
+}
+
+void
+vm_tlb_printstats(void)
+{
+	kprintf("vm: tlb: %s replacement, address space ids %s, "
+		"%u assigned, %u generations, %u flushes on generation "
+		"change\n", vm_tlb_policyname(),
+		asid_enabled ? "on" : "off", asid_assigned, asid_gen,
+		asid_flushes);
+}
+
+/*
+ * Choose a slot to evict under the nru policy. Interrupts are off.
+ * Clobbers EntryHi.
+ */
+static
+int
+tlb_nru_victim(void)
+{
+	uint32_t ehi, elo;
+	unsigned i, n;
+
+	/* At most one full sweep clearing bits, then a cleared one turns up. */
+	for (n=0; n<=NUM_TLB; n++) {
+		i = tlb_hand;
+		tlb_hand = (i + 1) % NUM_TLB;
+
+		tlb_read(&ehi, &elo, i);
+		if ((elo & TLBLO_VALID) == 0) {
+			return i;
+		}
+		tlb_write(ehi, elo & ~(uint32_t)TLBLO_VALID, i);
+	}
+	panic("vm: nru found no TLB victim\n");
+}
+
+/*
+ * Load a translation for VADDR. With PREFETCH, do nothing if there is
+ * one already, and count it as a prefetch rather than a fault.
+ * Returns true if anything was loaded.
+ */
+static
+bool
+tlb_load(vaddr_t vaddr, paddr_t paddr, bool writable, bool prefetch)
+{
+	uint32_t ehi, curhi, elo, oldhi, oldlo;
+	int i, spl;
+
+	KASSERT((vaddr & PAGE_FRAME) == vaddr);
+	KASSERT((paddr & PAGE_FRAME) == paddr);
+
+	elo = paddr | TLBLO_VALID;
+	if (writable) {
+		elo |= TLBLO_DIRTY;
+	}
+
+	/* Disable interrupts on this CPU while frobbing the TLB. */
+	spl = splhigh();
+
+	/* The entry goes in under the current address space's id. */
+	curhi = tlb_getentryhi();
+	ehi = vaddr | (curhi & TLBHI_PID);
+
+	/*
+	 * There must never be two entries for the same page, so if
+	 * there's one already (loaded read-only, or demoted by the nru
+	 * hand), reuse its slot. Nothing is evicted.
+	 */
+	i = tlb_probe(ehi, 0);
+	if (i >= 0 && prefetch) {
+		tlb_setentryhi(curhi);
+		splx(spl);
+		return false;
+	}
+	if (i >= 0) {
+		tlb_write(ehi, elo, i);
+		tlb_setentryhi(curhi);
+		splx(spl);
+		vmstats_inc(VMSTAT_TLB_FAULT_FREE);
+		return true;
+	}
+
+	for (i=0; i<NUM_TLB; i++) {
+		tlb_read(&oldhi, &oldlo, i);
+		if ((oldlo & TLBLO_VALID) || oldhi != (uint32_t)TLBHI_INVALID(i)) {
+			continue;
+		}
+		tlb_write(ehi, elo, i);
+		tlb_setentryhi(curhi);
+		splx(spl);
+		vmstats_inc(prefetch ? VMSTAT_TLB_PREFETCH :
+			    VMSTAT_TLB_FAULT_FREE);
+		return true;
+	}
+
+	switch (tlb_policy) {
+	    case TLBPOLICY_RANDOM:
+		tlb_random(ehi, elo);
+		break;
+	    case TLBPOLICY_NRU:
+		tlb_write(ehi, elo, tlb_nru_victim());
+		break;
+	    default:
+		i = tlb_hand;
+		tlb_hand = (i + 1) % NUM_TLB;
+		tlb_write(ehi, elo, i);
+		break;
+	}
+
+	tlb_setentryhi(curhi);
+	splx(spl);
+	vmstats_inc(prefetch ? VMSTAT_TLB_PREFETCH : VMSTAT_TLB_FAULT_REPLACE);
+	return true;
+}
+
+int
+vm_tlb_load(vaddr_t vaddr, paddr_t paddr, bool writable)
+{
+	tlb_load(vaddr, paddr, writable, false);
+	return 0;
+}
+
+bool
+vm_tlb_preload(vaddr_t vaddr, paddr_t paddr, bool writable)
+{
+	return tlb_load(vaddr, paddr, writable, true);
+}
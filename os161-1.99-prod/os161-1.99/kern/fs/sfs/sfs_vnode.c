@@ -44,11 +44,19 @@
 #include <vfs.h>
 #include <device.h>
 #include <sfs.h>
+#include <objcache.h>
 
 /* At bottom of file */
 static int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int type,
 			 struct sfs_vnode **ret);
 
+/*
+ * Cache of sfs_vnode structures, shared by all sfs volumes. Made the
+ * first time it's needed; protected by the vfs big lock.
+ */
+#define SFS_VNODE_CACHE_DEPTH 16
+static struct objcache *sfs_vnode_cache;
+
 ////////////////////////////////////////////////////////////
 //
 // Simple stuff
@@ -953,7 +961,7 @@ sfs_reclaim(struct vnode *v)
 	vfs_biglock_release();
 
 	/* Release the storage for the vnode structure itself. */
-	kfree(sv);
+	objcache_put(sfs_vnode_cache, sv);
 
 	/* Done */
 	return 0;
@@ -1685,7 +1693,17 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 
 	/* Didn't have it loaded; load it */
 
-	sv = kmalloc(sizeof(struct sfs_vnode));
+	if (sfs_vnode_cache == NULL) {
+		sfs_vnode_cache = objcache_create("sfs_vnode",
+						  sizeof(struct sfs_vnode),
+						  SFS_VNODE_CACHE_DEPTH,
+						  NULL, NULL);
+		if (sfs_vnode_cache == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	sv = objcache_get(sfs_vnode_cache);
 	if (sv==NULL) {
 		return ENOMEM;
 	}
@@ -1699,7 +1717,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Read the block the inode is in */
 	result = sfs_rblock(sfs, &sv->sv_i, ino);
 	if (result) {
-		kfree(sv);
+		objcache_put(sfs_vnode_cache, sv);
 		return result;
 	}
 
@@ -1736,7 +1754,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Call the common vnode initializer */
 	result = VOP_INIT(&sv->sv_v, ops, &sfs->sfs_absfs, sv);
 	if (result) {
-		kfree(sv);
+		objcache_put(sfs_vnode_cache, sv);
 		return result;
 	}
 
@@ -1747,7 +1765,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_v, NULL);
 	if (result) {
 		VOP_CLEANUP(&sv->sv_v);
-		kfree(sv);
+		objcache_put(sfs_vnode_cache, sv);
 		return result;
 	}
 
@@ -36,8 +36,11 @@
 
 
 #include <vm.h>
+#include "opt-dumbvm.h"
 
 struct vnode;
+struct pagetable;
+struct exectrace;
 
 
 /* 
@@ -47,6 +50,8 @@ struct vnode;
  * You write this.
  */
 
+#if OPT_DUMBVM
+
 struct addrspace {
   vaddr_t as_vbase1;
   paddr_t as_pbase1;
@@ -57,6 +62,114 @@ struct addrspace {
   paddr_t as_stackpbase;
 };
 
+#else /* !OPT_DUMBVM */
+
+/*
+ * The user stack region starts out VM_STACKPAGES long and grows down
+ * on demand, one fault at a time, to at most VM_STACKMAXPAGES. At
+ * least VM_STACKGUARD unmapped pages are always left between it and
+ * the region below (normally the heap), so running off either one
+ * faults instead of scribbling on the other.
+ */
+#define VM_STACKPAGES    2
+#define VM_STACKMAXPAGES 1024	/* 4M */
+#define VM_STACKGUARD    1
+
+/* Region permission bits (same meaning as the ELF PF_* flags) */
+#define VR_EXEC      0x1
+#define VR_WRITE     0x2
+#define VR_READ      0x4
+
+/* Region flags */
+#define VR_MAPPED    0x1	/* made by mmap; may be unmapped/reprotected */
+
+/*
+ * A region is a page-aligned range of virtual addresses with a single
+ * set of permissions. Pages inside a region are only given physical
+ * memory when they are first touched.
+ *
+ * A region loaded from an executable also remembers where its
+ * contents are in the file: the VR_FILESIZE bytes starting at
+ * VR_FILEBASE come from offset VR_FILEOFF of VR_VNODE. The rest of
+ * the region is zero-filled.
+ *
+ * Regions made by mmap are VR_MAPPED. They are anonymous: zero-filled
+ * and never backed by a file.
+ */
+struct vm_region {
+	vaddr_t vr_base;		/* first address (page-aligned) */
+	size_t vr_npages;		/* size in pages */
+	int vr_perms;			/* VR_READ | VR_WRITE | VR_EXEC */
+	int vr_flags;			/* VR_MAPPED */
+	struct vnode *vr_vnode;		/* backing file, or NULL */
+	off_t vr_fileoff;		/* file offset of vr_filebase */
+	vaddr_t vr_filebase;		/* first address backed by the file */
+	size_t vr_filesize;		/* number of bytes backed by the file */
+	struct vm_region *vr_next;	/* next region, by address */
+};
+
+struct addrspace {
+	struct vm_region *as_regions;	/* regions, sorted by address */
+	struct vm_region *as_heap;	/* heap, once the program is loaded */
+	vaddr_t as_brk;			/* current break, within as_heap */
+	struct vm_region *as_stack;	/* stack, once it has been defined */
+	struct pagetable *as_pt;	/* virtual page -> physical frame */
+	bool as_loading;		/* between prepare and complete load */
+	unsigned as_asid;		/* TLB address space id */
+	uint32_t as_asidgen;		/* ...and its generation, or 0 */
+	uint32_t as_cpus;		/* cpus that have used that id */
+	struct exectrace *as_trace;	/* pages touched, for exectrace.c */
+};
+
+/* Find the region containing VADDR, or NULL if it isn't mapped. */
+struct vm_region *as_find_region(struct addrspace *as, vaddr_t vaddr);
+
+/*
+ * Grow the stack down to cover VADDR, if that's within the stack
+ * limit and leaves the guard gap. Returns the stack region, or NULL.
+ */
+struct vm_region *as_grow_stack(struct addrspace *as, vaddr_t vaddr);
+
+/*
+ * Make the FILESIZE bytes at VADDR come from offset OFFSET of file V.
+ * They must lie within one region, defined earlier. Called by
+ * load_elf instead of reading the segment in; the pages are read in
+ * by vm_fault when they are first touched.
+ */
+int as_attach_file(struct addrspace *as, struct vnode *v, off_t offset,
+		   vaddr_t vaddr, size_t filesize);
+
+/*
+ * Move the break by AMOUNT bytes and return the old break in
+ * OLDBREAK. The heap starts out empty, right after the highest region
+ * defined by the loader, and always covers the pages up to the break.
+ * Pages added are zero-filled on first touch; pages that end up
+ * wholly past the break are freed. Moving the break below the start
+ * of the heap fails with EINVAL.
+ */
+int as_sbrk(struct addrspace *as, intptr_t amount, vaddr_t *oldbreak);
+
+/*
+ * Memory mappings.
+ *
+ *    as_mmap     - map LEN bytes of zero-filled memory with
+ *                  permissions PERMS, and return the address in RET.
+ *                  With FIXED, exactly at ADDR, which must be free;
+ *                  otherwise ADDR is only a hint, and mappings go top
+ *                  down from below the stack limit.
+ *    as_munmap   - remove the mappings in [ADDR, ADDR+LEN). Parts of
+ *                  mappings can be removed. EINVAL if the range
+ *                  covers anything that wasn't made by as_mmap.
+ *    as_mprotect - change the permissions of [ADDR, ADDR+LEN), which
+ *                  must be entirely mapped by as_mmap (else ENOMEM).
+ */
+int as_mmap(struct addrspace *as, vaddr_t addr, size_t len, int perms,
+	    bool fixed, vaddr_t *ret);
+int as_munmap(struct addrspace *as, vaddr_t addr, size_t len);
+int as_mprotect(struct addrspace *as, vaddr_t addr, size_t len, int perms);
+
+#endif /* OPT_DUMBVM */
+
 /*
  * Functions in addrspace.c:
  *
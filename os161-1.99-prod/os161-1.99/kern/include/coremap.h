@@ -0,0 +1,89 @@
+#ifndef _COREMAP_H_
+#define _COREMAP_H_
+
+#include <spinlock.h>
+
+struct addrspace;
+
+/*
+ * Coremap: the physical memory allocator used by the VM system once
+ * it has been bootstrapped.
+ *
+ *    coremap_bootstrap - take over all memory left by ram_getsize.
+ *                        Called from vm_bootstrap.
+ *    coremap_bootstrap2 - second stage, once kmalloc works.
+ *    coremap_ready     - true once coremap_bootstrap has run; before
+ *                        that, memory comes from ram_stealmem.
+ *    coremap_alloc     - allocate NPAGES physically contiguous frames.
+ *                        A single frame is O(1). Returns 0 if out of
+ *                        memory. KERNEL says whether the frames are
+ *                        for the kernel heap or for user pages.
+ *    coremap_free      - drop a reference to a block previously
+ *                        returned by coremap_alloc, freeing it when
+ *                        none are left. Frames that were stolen before
+ *                        the coremap existed are silently ignored.
+ *    coremap_nfree     - number of free frames (unlocked; a hint).
+ *    coremap_nframes   - number of frames the coremap manages.
+ *    coremap_frameno   - frame number (0 to coremap_nframes-1) of the
+ *                        frame at PADDR.
+ *    coremap_frameaddr - the reverse.
+ *    coremap_setkdata  - attach DATA to kernel frame PADDR, for the
+ *                        kernel heap's own use; kmalloc keeps the
+ *                        pageref of a subpage page there. Takes no
+ *                        lock: only the frame's owner writes it, and
+ *                        freeing the frame clears it. Frames stolen
+ *                        before the coremap existed are ignored.
+ *    coremap_getkdata  - read it back into *DATA, without locking.
+ *                        Returns false if PADDR isn't one of the
+ *                        coremap's frames, so nothing could be kept.
+ *
+ * The rest deal with user frames (single pages) and are called with
+ * coremap_lock held, which also protects the page table entries that
+ * point to user frames:
+ *
+ *    _coremap_free     - coremap_free with the lock held. A frame
+ *                        that is freed also leaves the text cache.
+ *    _coremap_share    - add a reference to PADDR, for another page
+ *                        table entry that maps it.
+ *    _coremap_refcount - number of references to PADDR.
+ *    _coremap_busy     - true if PADDR is being evicted.
+ *    _coremap_wait     - sleep until some busy frame stops being busy.
+ *                        Releases the lock while asleep.
+ *    _coremap_setowner - record that PADDR, newly allocated, now holds
+ *                        page VADDR of AS, making it evictable.
+ *    _coremap_touch    - note that PADDR, mapped at VADDR in AS, was
+ *                        just used.
+ *    _coremap_victim   - pick an unshared user frame to evict, mark it
+ *                        busy, and return it along with its owner. 0
+ *                        if there is nothing to evict.
+ *    _coremap_unbusy   - give up on evicting PADDR.
+ *    _coremap_reuse    - PADDR has been evicted; make it a fresh
+ *                        allocation for the caller instead.
+ */
+
+extern struct spinlock coremap_lock;
+
+void coremap_bootstrap(void);
+void coremap_bootstrap2(void);
+bool coremap_ready(void);
+paddr_t coremap_alloc(unsigned npages, bool kernel);
+void coremap_free(paddr_t paddr);
+unsigned coremap_nfree(void);
+unsigned coremap_nframes(void);
+unsigned coremap_frameno(paddr_t paddr);
+paddr_t coremap_frameaddr(unsigned frameno);
+void coremap_setkdata(paddr_t paddr, void *data);
+bool coremap_getkdata(paddr_t paddr, void **data);
+
+void _coremap_free(paddr_t paddr);
+void _coremap_share(paddr_t paddr);
+unsigned _coremap_refcount(paddr_t paddr);
+bool _coremap_busy(paddr_t paddr);
+void _coremap_wait(void);
+void _coremap_setowner(paddr_t paddr, struct addrspace *as, vaddr_t vaddr);
+void _coremap_touch(paddr_t paddr, struct addrspace *as, vaddr_t vaddr);
+paddr_t _coremap_victim(struct addrspace **as, vaddr_t *vaddr);
+void _coremap_unbusy(paddr_t paddr);
+void _coremap_reuse(paddr_t paddr, bool kernel);
+
+#endif /* _COREMAP_H_ */
@@ -36,6 +36,12 @@
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
 
+/*
+ * Number of scheduling priorities, and so of run queues per cpu.
+ * Priority 0 is the highest.
+ */
+#define SCHED_NPRIO 4
+
 /*
  * Per-cpu structure
  *
@@ -60,13 +66,17 @@ struct cpu {
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	uint32_t c_asidgen;		/* ASID generation of TLB contents */
+	unsigned c_nsteals;		/* Threads taken from other cpus */
 
 	/*
 	 * Accessed by other cpus.
-	 * Protected by the runqueue lock.
+	 * Protected by the runqueue lock. Other cpus also read
+	 * c_runcount without it, as a hint when looking for work.
 	 */
 	bool c_isidle;			/* True if this cpu is idle */
-	struct threadlist c_runqueue;	/* Run queue for this cpu */
+	struct threadlist c_runqueue[SCHED_NPRIO]; /* Run queues, by priority */
+	unsigned c_runcount;		/* Threads on all the run queues */
 	struct spinlock c_runqueue_lock;
 
 	/*
@@ -109,6 +119,11 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Number of cpus in the system; cpu numbers run from 0 to one less.
+ */
+unsigned cpu_count(void);
+
 /*
  * Return a string describing the CPU type.
  */
@@ -152,6 +167,11 @@ void cpu_halt(void);
  * ipi_send sends an IPI to one CPU.
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
+ * ipi_tlbshootdown_cpus sends N mappings to each CPU in CPUMASK (bit
+ * c_number set) except the current one, one IPI per CPU, and returns
+ * how many CPUs that was. Each of them handles the lot in a single
+ * call to vm_tlbshootdown or vm_tlbshootdown_all, along with anything
+ * else that was queued for it at the time.
  *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
@@ -166,6 +186,8 @@ void cpu_halt(void);
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
 void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+unsigned ipi_tlbshootdown_cpus(uint32_t cpumask,
+			       const struct tlbshootdown *mappings, unsigned n);
 
 void interprocessor_interrupt(void);
 
@@ -0,0 +1,48 @@
+#ifndef _EXECTRACE_H_
+#define _EXECTRACE_H_
+
+struct addrspace;
+struct vm_region;
+struct vnode;
+struct fs;
+
+/*
+ * Exec-time working set prefetch.
+ *
+ * A program touches much the same pages of its file, in much the
+ * same order, every time it runs. So each run records the pages of
+ * its program file it touches, and when it exits the trace is kept
+ * for that file. The next time the program is started, the pages in
+ * the trace are read in (using the fault-around reads, so in
+ * batches) before it gets to user mode.
+ *
+ * Traces are kept for the last EXECTRACE_FILES programs run, each
+ * holding a reference to its file, and are thrown away if the file
+ * has been written to since (see vn_wgen).
+ *
+ *    exectrace_bootstrap  - set up. Called from vm_bootstrap.
+ *    exectrace_exec       - AS has just been loaded from program V:
+ *                           prefetch its pages, and start recording a
+ *                           new trace. Called by runprogram.
+ *    exectrace_note       - AS touched page VADDR of region VR.
+ *                           Called from vm_fault, in AS's own thread.
+ *    exectrace_exit       - AS is being destroyed: keep its trace.
+ *    exectrace_release    - drop the traces of files on FS, which is
+ *                           being unmounted (they'd keep it busy).
+ *    exectrace_printstats - print statistics.
+ */
+
+#define EXECTRACE_FILES    8
+#define EXECTRACE_MAXRUNS  64
+
+struct exectrace;
+
+void exectrace_bootstrap(void);
+void exectrace_exec(struct addrspace *as, struct vnode *v);
+void exectrace_note(struct addrspace *as, struct vm_region *vr,
+		    vaddr_t vaddr);
+void exectrace_exit(struct addrspace *as);
+void exectrace_release(struct fs *fs);
+void exectrace_printstats(void);
+
+#endif /* _EXECTRACE_H_ */
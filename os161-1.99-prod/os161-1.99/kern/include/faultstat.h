@@ -0,0 +1,32 @@
+#ifndef _FAULTSTAT_H_
+#define _FAULTSTAT_H_
+
+#include <kern/faultstat.h>
+
+/*
+ * Page fault statistics, per process and per cpu (see
+ * <kern/faultstat.h> for what they count).
+ *
+ * A cpu's statistics are only changed by that cpu, with interrupts
+ * off, and a process's only by its own thread, so counting a fault
+ * takes no lock. Anyone else reading them gets a snapshot that may be
+ * a fault or two behind.
+ *
+ *    faultstat_record - count a fault, for this cpu and curproc. WHAT
+ *                       has bit (1 << FAULTSTAT_x) set for each thing
+ *                       the fault took; NSECS is how long it took.
+ *    faultstat_get    - fetch the statistics of the calling process
+ *                       (FAULTSTAT_SELF), of one cpu, or the total
+ *                       over all cpus (FAULTSTAT_ALL). EINVAL if there
+ *                       is no such cpu.
+ *    faultstat_print  - print the per-cpu statistics and totals, then
+ *                       the counts of each live user process.
+ */
+
+#define FAULTSTAT_MAXCPUS  32
+
+void faultstat_record(unsigned what, uint32_t nsecs);
+int faultstat_get(int which, struct faultstat *fs);
+void faultstat_print(void);
+
+#endif /* _FAULTSTAT_H_ */
@@ -0,0 +1,41 @@
+#ifndef _KERN_FAULTSTAT_H_
+#define _KERN_FAULTSTAT_H_
+
+/*
+ * Page fault statistics, as returned by faultstat().
+ *
+ * fs_count counts the faults handled, by what they took:
+ *
+ *    FAULTSTAT_TLB    - every fault handled (each ends up loading the
+ *                       TLB).
+ *    FAULTSTAT_ZERO   - page zero-filled.
+ *    FAULTSTAT_FILE   - page read in from its file.
+ *    FAULTSTAT_SWAPIN - page read back from swap.
+ *    FAULTSTAT_COW    - copy-on-write page made private, by copying
+ *                       it or by taking over the last reference.
+ *
+ * fs_latency is a histogram of how long faults took to handle: bucket
+ * i counts those that took from 2^i to 2^(i+1)-1 nanoseconds (bucket 0
+ * also gets those under a nanosecond; the last, all longer ones).
+ */
+
+#define FAULTSTAT_TLB      0
+#define FAULTSTAT_ZERO     1
+#define FAULTSTAT_FILE     2
+#define FAULTSTAT_SWAPIN   3
+#define FAULTSTAT_COW      4
+#define FAULTSTAT_COUNT    5
+
+#define FAULTSTAT_BUCKETS  32
+
+/* First argument of faultstat(): whose statistics */
+#define FAULTSTAT_SELF     (-1)	/* the calling process */
+#define FAULTSTAT_ALL      (-2)	/* the whole system */
+				/* 0 and up: that cpu */
+
+struct faultstat {
+	__u32 fs_count[FAULTSTAT_COUNT];
+	__u32 fs_latency[FAULTSTAT_BUCKETS];
+};
+
+#endif /* _KERN_FAULTSTAT_H_ */
@@ -0,0 +1,28 @@
+#ifndef _KERN_MMAN_H_
+#define _KERN_MMAN_H_
+
+/*
+ * Definitions for mmap(), munmap(), and mprotect().
+ */
+
+/* Protections (mmap, mprotect) */
+#define PROT_NONE     0x0	/* No access */
+#define PROT_READ     0x1	/* Pages may be read */
+#define PROT_WRITE    0x2	/* Pages may be written */
+#define PROT_EXEC     0x4	/* Pages may be executed */
+
+/*
+ * Flags for mmap(). Exactly one of MAP_SHARED and MAP_PRIVATE is
+ * required. For now only anonymous private mappings are supported.
+ */
+#define MAP_SHARED    0x0001	/* Changes go back to the file */
+#define MAP_PRIVATE   0x0002	/* Changes are private */
+#define MAP_FIXED     0x0010	/* Map exactly at the address given */
+#define MAP_ANON      0x1000	/* Zero-filled, not backed by a file */
+#define MAP_ANONYMOUS MAP_ANON
+
+/* Returned by mmap() on error. */
+#define MAP_FAILED    ((void *)-1)
+
+
+#endif /* _KERN_MMAN_H_ */
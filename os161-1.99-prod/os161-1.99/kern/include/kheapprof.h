@@ -0,0 +1,25 @@
+#ifndef _KHEAPPROF_H_
+#define _KHEAPPROF_H_
+
+/*
+ * Kernel heap profiler, built with "options kheapprof". Without the
+ * option none of this exists and kmalloc doesn't call it.
+ *
+ * kmalloc reports each allocation with its size and the address it
+ * was called from, and kfree reports each free. Live allocations and
+ * bytes are totalled per call site. Allocations made by a wrapper,
+ * such as kstrdup or objcache_get, are charged to the wrapper.
+ *
+ *    kheapprof_alloc  - PTR, SIZE bytes, was just allocated from PC.
+ *    kheapprof_free   - PTR is about to be freed.
+ *    kheapprof_report - print the call sites with the most live bytes,
+ *                       and the ones whose live bytes grew since the
+ *                       last report (a leak report). The next report
+ *                       compares against this one.
+ */
+
+void kheapprof_alloc(void *ptr, size_t size, vaddr_t pc);
+void kheapprof_free(void *ptr);
+void kheapprof_report(void);
+
+#endif /* _KHEAPPROF_H_ */
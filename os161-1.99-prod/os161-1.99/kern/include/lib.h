@@ -122,10 +122,12 @@ uint32_t random(void);
 /*
  * Kernel heap memory allocation. Like malloc/free.
  * If out of memory, kmalloc returns NULL.
+ * kmalloc_cpuinit sets up per-cpu caches for a new cpu (cpu_create).
  */
 void *kmalloc(size_t size);
 void kfree(void *ptr);
 void kheap_printstats(void);
+void kmalloc_cpuinit(unsigned cpunum);
 
 /*
  * C string functions. 
@@ -0,0 +1,44 @@
+#ifndef _OBJCACHE_H_
+#define _OBJCACHE_H_
+
+/*
+ * Object caches, for kernel structures that are created and destroyed
+ * all the time.
+ *
+ * A cache hands out objects of one size. It keeps up to DEPTH of the
+ * ones it gets back, still constructed, and hands those out again
+ * first. Reusing one skips both the kmalloc and whatever the
+ * constructor does, such as making a wait channel.
+ *
+ *    objcache_create   - make a cache called NAME (a string constant)
+ *                        of SIZE-byte objects. CTOR, if not NULL, sets
+ *                        up each new object and returns 0 or an error
+ *                        code; DTOR, if not NULL, undoes it before the
+ *                        memory is freed. Returns NULL if out of
+ *                        memory. Caches are never destroyed.
+ *    objcache_get      - get an object, in the state CTOR (or the last
+ *                        user) left it. NULL if out of memory.
+ *    objcache_getcount - like objcache_get, but if the object is a
+ *                        spare also bump *SAVED (when not NULL), under
+ *                        the cache's lock. Lets a caller count the
+ *                        reuses on one path of its own.
+ *    objcache_put      - give an object back. It must be in the state
+ *                        CTOR leaves objects in.
+ *    objcache_printstats - print statistics for each cache.
+ *
+ * The constructor and destructor are called without any locks held,
+ * so they can allocate memory.
+ */
+
+struct objcache;
+
+struct objcache *objcache_create(const char *name, size_t size,
+				 unsigned depth,
+				 int (*ctor)(void *obj),
+				 void (*dtor)(void *obj));
+void *objcache_get(struct objcache *oc);
+void *objcache_getcount(struct objcache *oc, unsigned *saved);
+void objcache_put(struct objcache *oc, void *obj);
+void objcache_printstats(void);
+
+#endif /* _OBJCACHE_H_ */
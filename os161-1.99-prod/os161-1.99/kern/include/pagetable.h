@@ -0,0 +1,49 @@
+#ifndef _PAGETABLE_H_
+#define _PAGETABLE_H_
+
+/*
+ * Two-level page table.
+ *
+ * A user virtual address is split into a 10-bit directory index, a
+ * 10-bit table index, and a 12-bit page offset. The directory is
+ * always present; each second-level table is one page of PTEs and is
+ * only allocated once some page it covers is touched.
+ */
+
+typedef uint32_t pte_t;
+
+#define PT_NENTRIES      1024
+#define PT_DIRINDEX(va)  (((va) >> 22) & (PT_NENTRIES - 1))
+#define PT_TBLINDEX(va)  (((va) >> 12) & (PT_NENTRIES - 1))
+
+/*
+ * Fields in a page table entry. A page that is not resident may be
+ * in swap, in which case the slot number takes the place of the
+ * frame. An entry of 0 means the page has never been touched.
+ */
+#define PTE_FRAME        0xfffff000	/* physical frame, if PTE_VALID */
+#define PTE_VALID        0x00000001	/* page is resident in PTE_FRAME */
+#define PTE_COW          0x00000002	/* frame may be shared; copy on write */
+#define PTE_SWAPPED      0x00000004	/* page is in swap slot PTE_SLOT */
+
+#define PTE_SLOT(pte)     ((pte) >> 12)
+#define PTE_MKSWAP(slot)  (((pte_t)(slot) << 12) | PTE_SWAPPED)
+
+struct pagetable {
+	pte_t *pt_dir[PT_NENTRIES];	/* second-level tables, or NULL */
+};
+
+/*
+ * pt_create  - make an empty page table. Returns NULL if out of memory.
+ * pt_destroy - free the table structure. Does not touch the frames
+ *              the entries refer to; the caller frees those first.
+ * pt_lookup  - return a pointer to the PTE for VADDR. If the
+ *              second-level table doesn't exist yet, allocate it if
+ *              CREATE is set, else return NULL. Also returns NULL if
+ *              the allocation fails.
+ */
+struct pagetable *pt_create(void);
+void pt_destroy(struct pagetable *pt);
+pte_t *pt_lookup(struct pagetable *pt, vaddr_t vaddr, bool create);
+
+#endif /* _PAGETABLE_H_ */
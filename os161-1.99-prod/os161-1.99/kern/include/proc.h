@@ -38,12 +38,11 @@
 
 #include <spinlock.h>
 #include <thread.h> /* required for struct threadarray */
+#include <kern/faultstat.h>
 
 struct addrspace;
 struct vnode;
-#ifdef UW
 struct semaphore;
-#endif // UW
 
 /*
  * Process structure.
@@ -55,6 +54,7 @@ struct proc {
 
 	/* VM */
 	struct addrspace *p_addrspace;	/* virtual address space */
+	struct faultstat p_faultstat;	/* page faults; see faultstat.h */
 
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
@@ -68,6 +68,19 @@ struct proc {
   struct vnode *console;                /* a vnode for the console device */
 #endif
 
+	pid_t p_pid;			/* process id; 0 for kproc */
+
+	/*
+	 * vfork: while this is set, the process is running in its
+	 * parent's address space and the parent is waiting on it for
+	 * the process to exec or exit. See proc_vforkdone.
+	 */
+	struct semaphore *p_vforksem;
+
+	/* list of all user processes; see proc_foreach */
+	struct proc *p_prevproc;
+	struct proc *p_nextproc;
+
 	/* add more material here as needed */
 };
 
@@ -85,6 +98,22 @@ void proc_bootstrap(void);
 /* Create a fresh process for use by runprogram(). */
 struct proc *proc_create_runprogram(const char *name);
 
+/* Number of user processes created so far. */
+unsigned proc_forkcount(void);
+
+/* How many of them reused a cached proc structure. */
+unsigned proc_forksaved(void);
+
+/*
+ * Call FUNC on each user process, with DATA. None of them can be
+ * destroyed meanwhile, and none created; FUNC may sleep, but mustn't
+ * create or destroy a process itself.
+ */
+void proc_foreach(void (*func)(struct proc *proc, void *data), void *data);
+
+/* Give a vforked process's parent its address space back. */
+void proc_vforkdone(struct proc *proc);
+
 /* Destroy a process. */
 void proc_destroy(struct proc *proc);
 
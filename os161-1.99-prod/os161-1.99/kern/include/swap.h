@@ -0,0 +1,29 @@
+#ifndef _SWAP_H_
+#define _SWAP_H_
+
+/*
+ * Swap space: page-sized slots on the raw disk SWAP_DEVICE.
+ *
+ *    swap_bootstrap - open the swap device. If it isn't there, the
+ *                     system runs without swap. Called from
+ *                     vm_bootstrap.
+ *    swap_alloc     - allocate a free slot and return it in SLOT.
+ *                     Returns ENOSPC if swap is full or missing.
+ *    swap_share     - add a reference to SLOT, for another page table
+ *                     entry (copy-on-write fork of a swapped page).
+ *    swap_free      - drop a reference to SLOT; freed when none are
+ *                     left. Never sleeps.
+ *    swap_in        - read SLOT into the frame at PADDR.
+ *    swap_out       - write the frame at PADDR to SLOT.
+ */
+
+#define SWAP_DEVICE  "lhd1raw:"
+
+void swap_bootstrap(void);
+int swap_alloc(unsigned *slot);
+void swap_share(unsigned slot);
+void swap_free(unsigned slot);
+int swap_in(unsigned slot, paddr_t paddr);
+int swap_out(unsigned slot, paddr_t paddr);
+
+#endif /* _SWAP_H_ */
@@ -37,6 +37,11 @@
 
 #include <spinlock.h>
 
+/*
+ * Set up the lock and CV caches. Called once, early in boot.
+ */
+void synch_bootstrap(void);
+
 /*
  * Dijkstra-style semaphore.
  *
@@ -62,7 +62,15 @@ int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
 int sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval);
 void sys__exit(int exitcode);
 int sys_getpid(pid_t *retval);
+int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
 int sys_waitpid(pid_t pid, userptr_t status, int options, pid_t *retval);
+int sys_sbrk(intptr_t amount, vaddr_t *retval);
+int sys_mmap(userptr_t addr, size_t len, int prot, int flags,
+             vaddr_t *retval);
+int sys_munmap(userptr_t addr, size_t len);
+int sys_mprotect(userptr_t addr, size_t len, int prot);
+int sys_faultstat(int which, userptr_t buf);
 
 #endif // UW
 
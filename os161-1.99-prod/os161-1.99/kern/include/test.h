@@ -57,6 +57,8 @@ int queuetest(int, char **);
 int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
+int schedtest(int, char **);
+int balancetest(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
@@ -79,6 +81,7 @@ int printfile(int, char **);
 /* other tests */
 int malloctest(int, char **);
 int mallocstress(int, char **);
+int mallocthroughput(int, char **);
 int nettest(int, char **);
 
 /* Routine for running a user-level program. */
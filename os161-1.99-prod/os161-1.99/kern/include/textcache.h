@@ -0,0 +1,42 @@
+#ifndef _TEXTCACHE_H_
+#define _TEXTCACHE_H_
+
+struct vm_region;
+
+/*
+ * Text page cache: resident pages of read-only executable regions,
+ * found by file and address, so that processes running the same
+ * program share one copy of each page of its text.
+ *
+ * A cached frame is an ordinary user frame, shared through the
+ * coremap reference count like a copy-on-write page. It stays in the
+ * cache as long as some page table maps it: when the last reference
+ * goes, or the frame is evicted, it leaves the cache.
+ *
+ *    textcache_bootstrap - set up. Called from vm_bootstrap, after the
+ *                          coremap.
+ *    textcache_eligible  - true if the pages of VR can be cached.
+ *    textcache_printstats - print statistics.
+ *
+ * The rest are called with coremap_lock held, which protects the
+ * cache too:
+ *
+ *    _textcache_lookup   - find the frame holding page VADDR of VR, add
+ *                          a reference to it, and return it. 0 if it
+ *                          isn't cached.
+ *    _textcache_insert   - enter PADDR, just read in, as page VADDR of
+ *                          VR. Returns false (and does nothing) if that
+ *                          page is cached already.
+ *    _textcache_remove   - take PADDR out of the cache, if it's in it.
+ *                          Returns true if it was.
+ */
+
+void textcache_bootstrap(void);
+bool textcache_eligible(struct vm_region *vr);
+void textcache_printstats(void);
+
+paddr_t _textcache_lookup(struct vm_region *vr, vaddr_t vaddr);
+bool _textcache_insert(struct vm_region *vr, vaddr_t vaddr, paddr_t paddr);
+bool _textcache_remove(paddr_t paddr);
+
+#endif /* _TEXTCACHE_H_ */
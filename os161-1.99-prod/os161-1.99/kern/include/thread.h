@@ -83,6 +83,8 @@ struct thread {
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
+	unsigned t_prio;		/* Scheduling priority; 0 is highest */
+	unsigned t_ticks;		/* Hardclocks used at this priority */
 
 	/*
 	 * Interrupt state fields.
@@ -158,15 +160,31 @@ void thread_exit(void);
 void thread_yield(void);
 
 /*
- * Reshuffle the run queue. Called from the timer interrupt.
+ * Charge the current thread for a clock tick, and return true if it
+ * should yield: because it has used up its quantum, in which case it
+ * also drops a priority level, or because a thread of higher priority
+ * is waiting. Called from the timer interrupt.
+ */
+bool thread_tick(void);
+
+/*
+ * Boost the current thread and every thread queued on this cpu back
+ * to the top priority, so that threads that have sunk to the bottom
+ * levels aren't starved. Called from the timer interrupt, once every
+ * SCHEDULE_HARDCLOCKS ticks (once a second).
  */
 void schedule(void);
 
 /*
- * Potentially migrate ready threads to other CPUs. Called from the
- * timer interrupt.
+ * Number of threads started in user processes that reused a cached
+ * thread structure.
+ */
+unsigned thread_forksaved(void);
+
+/*
+ * Number of threads idle CPUs have stolen from busy ones.
  */
-void thread_consider_migration(void);
+unsigned thread_nsteals(void);
 
 
 #endif /* _THREAD_H_ */
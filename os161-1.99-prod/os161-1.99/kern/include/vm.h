@@ -39,6 +39,8 @@
 
 #include <machine/vm.h>
 
+struct addrspace;
+
 /* Fault-type arguments to vm_fault() */
 #define VM_FAULT_READ        0    /* A read was attempted */
 #define VM_FAULT_WRITE       1    /* A write was attempted */
@@ -51,13 +53,117 @@ void vm_bootstrap(void);
 /* Fault handling function called by trap code */
 int vm_fault(int faulttype, vaddr_t faultaddress);
 
+/*
+ * Read in the file pages among NPAGES pages at VADDR of the current
+ * address space AS ahead of time (see exectrace.h). Gives up if free
+ * memory drops below VM_PREFETCH_MINFREE frames. Returns the number
+ * of pages read.
+ */
+#define VM_PREFETCH_MINFREE  64
+unsigned vm_prefetch(struct addrspace *as, vaddr_t vaddr, unsigned npages);
+
 /* Allocate/free kernel heap pages (called by kmalloc/kfree) */
 vaddr_t alloc_kpages(int npages);
 void free_kpages(vaddr_t addr);
 
-/* TLB shootdown handling called from interprocessor_interrupt */
+/*
+ * TLB shootdown handling called from interprocessor_interrupt, once
+ * per IPI: either everything, or the N mappings in TS.
+ */
 void vm_tlbshootdown_all(void);
-void vm_tlbshootdown(const struct tlbshootdown *);
+void vm_tlbshootdown(const struct tlbshootdown *ts, int n);
+
+/*
+ * Called by an idle cpu with interrupts off, to do a bit of background
+ * work (zeroing a frame). Returns false if there was nothing to do, in
+ * which case the cpu really idles.
+ */
+bool vm_idle(void);
+
+/* Allocate/free single physical frames for user pages (not zeroed) */
+paddr_t alloc_upage(void);
+void free_upage(paddr_t paddr);
+
+/*
+ * VM statistics not covered by uw-vmstats.
+ *
+ *    vm_cow_forked - as_copy shared NPAGES pages with a new address
+ *                    space instead of copying them.
+ *    vm_printstats - print them.
+ */
+void vm_cow_forked(unsigned npages);
+void vm_printstats(void);
+
+/*
+ * Fault-around. When vm_fault handles a fault it also loads TLB
+ * entries for up to this many resident pages on either side of the
+ * page, in the same region, and when it has to read a page from a
+ * file it reads up to this many following pages of the file in the
+ * same I/O. 0 turns it off.
+ *
+ *    vm_setfaultaround - set the window, at most VM_FAULTAROUND_MAX.
+ *                        Returns EINVAL if too big.
+ *    vm_faultaround    - the current window.
+ */
+#define VM_FAULTAROUND_MAX  16
+
+int vm_setfaultaround(unsigned npages);
+unsigned vm_faultaround(void);
+
+/*
+ * Remove the N pages at VADDRS of AS from every TLB, sending IPIs to
+ * the other cpus that might have them, and wait until they're gone.
+ * May sleep.
+ */
+void vm_shootdown(struct addrspace *as, const vaddr_t *vaddrs, unsigned n);
+
+/*
+ * Machine-dependent TLB management for the paged VM system.
+ *
+ *    vm_tlb_load       - enter a translation for the page containing
+ *                        VADDR on this cpu, replacing any existing one
+ *                        for it. If the TLB is full, a victim is chosen
+ *                        by the replacement policy.
+ *    vm_tlb_preload    - like vm_tlb_load, but for a page nobody has
+ *                        asked for yet: does nothing if there's an
+ *                        entry for VADDR already. Returns true if it
+ *                        loaded one.
+ *    vm_tlb_flush      - throw away every translation on this cpu.
+ *    vm_tlb_invalidate - throw away AS's translation for VADDR, if any,
+ *                        on this cpu.
+ *    vm_tlb_activate   - make AS the address space translations are
+ *                        looked up (and loaded) for on this cpu. Other
+ *                        address spaces' translations are kept.
+ *    vm_tlb_forget     - throw away all of AS's translations, on every
+ *                        cpu.
+ *    vm_tlb_cpus       - the cpus (one bit per c_number) whose TLBs may
+ *                        hold translations for AS.
+ *    vm_tlb_printstats - print TLB statistics.
+ *    vm_tlb_setpolicy  - select the replacement policy by name ("rr",
+ *                        "random", or "nru"). Returns EINVAL if unknown.
+ *    vm_tlb_policyname - name of the current replacement policy.
+ *    vm_tlb_setasids   - turn address space ids on or off. Off, the TLB
+ *                        is flushed on every activation, for comparing
+ *                        TLB fault counts with and without them.
+ *    vm_tlb_asids      - whether they're on.
+ */
+#define TLBPOLICY_RR      0	/* round-robin */
+#define TLBPOLICY_RANDOM  1	/* hardware Random register */
+#define TLBPOLICY_NRU     2	/* not recently used / second chance */
+#define TLBPOLICY_COUNT   3
+
+int vm_tlb_load(vaddr_t vaddr, paddr_t paddr, bool writable);
+bool vm_tlb_preload(vaddr_t vaddr, paddr_t paddr, bool writable);
+void vm_tlb_flush(void);
+void vm_tlb_invalidate(struct addrspace *as, vaddr_t vaddr);
+void vm_tlb_activate(struct addrspace *as);
+void vm_tlb_forget(struct addrspace *as);
+uint32_t vm_tlb_cpus(struct addrspace *as);
+int vm_tlb_setpolicy(const char *name);
+const char *vm_tlb_policyname(void);
+void vm_tlb_setasids(bool on);
+bool vm_tlb_asids(void);
+void vm_tlb_printstats(void);
 
 
 #endif /* _VM_H_ */
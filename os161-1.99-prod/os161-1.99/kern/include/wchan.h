@@ -37,6 +37,11 @@
 
 struct wchan; /* Opaque */
 
+/*
+ * Set up. Called once, early in boot.
+ */
+void wchan_bootstrap(void);
+
 /*
  * Create a wait channel. Use NAME as a symbolic name for the channel.
  * NAME should be a string constant; if not, the caller is responsible
@@ -49,6 +54,12 @@ struct wchan *wchan_create(const char *name);
  */
 void wchan_destroy(struct wchan *wc);
 
+/*
+ * Change the name of a wait channel, with the same rules for NAME as
+ * wchan_create. For objects that keep their channel across reuse.
+ */
+void wchan_setname(struct wchan *wc, const char *name);
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
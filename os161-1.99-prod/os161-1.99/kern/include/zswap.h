@@ -0,0 +1,56 @@
+#ifndef _ZSWAP_H_
+#define _ZSWAP_H_
+
+/*
+ * Compressed swap cache: a pool of kernel memory in front of the swap
+ * disk. Pages being swapped out are compressed into it, and only go
+ * to disk if they don't compress well, or, when the pool is full and
+ * can't grow, once they are the oldest page in it. It works under the
+ * swap code, by swap slot; nothing above that knows it is there.
+ *
+ *    zswap_bootstrap  - set up the pool, for a swap area of NSLOTS
+ *                       slots. Called from swap_bootstrap. The pool
+ *                       starts out with as many frames as it will
+ *                       ever shrink to. If there is no memory for
+ *                       its tables, pages all go to disk.
+ *    zswap_store      - try to keep the page at PADDR as SLOT. Returns
+ *                       EFBIG if it doesn't compress well enough, and
+ *                       ENOSPC if the pool is full; write back the
+ *                       oldest page and try again, or send this one
+ *                       to disk.
+ *    zswap_load       - if SLOT is in the pool, decompress it into the
+ *                       frame at PADDR and return true. It stays in
+ *                       the pool until dropped, since the slot may be
+ *                       shared.
+ *    zswap_drop       - forget SLOT, which is being freed. Never
+ *                       sleeps.
+ *    zswap_oldest     - pick the page that has been in the pool the
+ *                       longest, to be written back, and return its
+ *                       SLOT. False if there is none. Call with the
+ *                       swap code's lock held, and take a reference
+ *                       to the slot before letting go, so it can't be
+ *                       freed while it is being written. Never sleeps.
+ *    zswap_writeback  - decompress SLOT, picked by zswap_oldest, into
+ *                       the frame at PADDR, to be written to disk.
+ *                       It stays in the pool, so it can still be
+ *                       loaded, until zswap_written.
+ *    zswap_written    - SLOT has been written to disk (OK), so drop
+ *                       it from the pool; or it couldn't be, so keep
+ *                       it as the newest page.
+ *    zswap_shrink     - give back the pool's empty frames, above the
+ *                       ones it started with. Returns true if
+ *                       there were any. Never sleeps.
+ *    zswap_printstats - print statistics.
+ */
+
+void zswap_bootstrap(unsigned nslots);
+int zswap_store(unsigned slot, paddr_t paddr);
+bool zswap_load(unsigned slot, paddr_t paddr);
+void zswap_drop(unsigned slot);
+bool zswap_oldest(unsigned *slot);
+bool zswap_writeback(unsigned slot, paddr_t paddr);
+void zswap_written(unsigned slot, bool ok);
+bool zswap_shrink(void);
+void zswap_printstats(void);
+
+#endif /* _ZSWAP_H_ */
@@ -43,12 +43,15 @@
  */
 
 #include <types.h>
+#include <limits.h>
+#include <bitmap.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
 #include <vnode.h>
 #include <vfs.h>
 #include <synch.h>
+#include <objcache.h>
 #include <kern/fcntl.h>  
 
 /*
@@ -69,7 +72,78 @@ static struct semaphore *proc_count_mutex;
 struct semaphore *no_proc_sem;   
 #endif  // UW
 
+/*
+ * Process ids in use, and where to start looking for the next free
+ * one; both protected by proc_count_mutex. Ids are handed out in
+ * order, wrapping around after PID_MAX and skipping any still held by
+ * a live process.
+ */
+static struct bitmap *pid_inuse;
+static pid_t next_pid = PID_MIN;
+
+/* Every user process, newest first; same lock. */
+static struct proc *allprocs;
 
+/* Number of processes proc_create_runprogram has made; same lock. */
+static unsigned proc_nforks;
+
+/*
+ * How many of those got a cached proc structure; counted under the
+ * cache's lock. kproc is the first proc ever made, so it can't be one.
+ */
+static unsigned proc_nsaved;
+
+/*
+ * Cache of proc structures. A cached proc keeps its (empty) thread
+ * array, so the first proc_addthread usually doesn't allocate.
+ */
+#define PROC_CACHE_DEPTH 8
+static struct objcache *proc_cache;
+
+static
+int
+proc_ctor(void *obj)
+{
+	struct proc *proc = obj;
+
+	threadarray_init(&proc->p_threads);
+	spinlock_init(&proc->p_lock);
+	return 0;
+}
+
+static
+void
+proc_dtor(void *obj)
+{
+	struct proc *proc = obj;
+
+	threadarray_cleanup(&proc->p_threads);
+	spinlock_cleanup(&proc->p_lock);
+}
+
+
+
+/*
+ * Find a free process id, mark it in use, and advance next_pid past
+ * it. Returns 0 if every id is taken. Caller holds proc_count_mutex.
+ */
+static
+pid_t
+pid_alloc(void)
+{
+	pid_t pid;
+	unsigned i;
+
+	for (i=0; i<=PID_MAX-PID_MIN; i++) {
+		pid = next_pid;
+		next_pid = next_pid == PID_MAX ? PID_MIN : next_pid + 1;
+		if (!bitmap_isset(pid_inuse, pid)) {
+			bitmap_mark(pid_inuse, pid);
+			return pid;
+		}
+	}
+	return 0;
+}
 
 /*
  * Create a proc structure.
@@ -80,21 +154,22 @@ proc_create(const char *name)
 {
 	struct proc *proc;
 
-	proc = kmalloc(sizeof(*proc));
+	proc = objcache_getcount(proc_cache, &proc_nsaved);
 	if (proc == NULL) {
 		return NULL;
 	}
 	proc->p_name = kstrdup(name);
 	if (proc->p_name == NULL) {
-		kfree(proc);
+		objcache_put(proc_cache, proc);
 		return NULL;
 	}
 
-	threadarray_init(&proc->p_threads);
-	spinlock_init(&proc->p_lock);
+	/* p_threads and p_lock were set up by proc_ctor. */
+	KASSERT(threadarray_num(&proc->p_threads) == 0);
 
 	/* VM fields */
 	proc->p_addrspace = NULL;
+	bzero(&proc->p_faultstat, sizeof(proc->p_faultstat));
 
 	/* VFS fields */
 	proc->p_cwd = NULL;
@@ -103,6 +178,11 @@ proc_create(const char *name)
 	proc->console = NULL;
 #endif // UW
 
+	proc->p_pid = 0;
+	proc->p_vforksem = NULL;
+	proc->p_prevproc = NULL;
+	proc->p_nextproc = NULL;
+
 	return proc;
 }
 
@@ -120,9 +200,11 @@ proc_destroy(struct proc *proc)
          * be defined because the calling thread may have already detached itself
          * from the process.
 	 */
+	pid_t pid;
 
 	KASSERT(proc != NULL);
 	KASSERT(proc != kproc);
+	KASSERT(proc->p_vforksem == NULL);
 
 	/*
 	 * We don't take p_lock in here because we must have the only
@@ -163,11 +245,27 @@ proc_destroy(struct proc *proc)
 	}
 #endif // UW
 
-	threadarray_cleanup(&proc->p_threads);
-	spinlock_cleanup(&proc->p_lock);
+	/* p_threads and p_lock are kept for reuse; see proc_dtor. */
+	KASSERT(threadarray_num(&proc->p_threads) == 0);
+
+#ifdef UW
+	/* before anyone walking the list can see it go */
+	P(proc_count_mutex);
+	if (proc->p_prevproc != NULL) {
+		proc->p_prevproc->p_nextproc = proc->p_nextproc;
+	}
+	else if (allprocs == proc) {
+		allprocs = proc->p_nextproc;
+	}
+	if (proc->p_nextproc != NULL) {
+		proc->p_nextproc->p_prevproc = proc->p_prevproc;
+	}
+	V(proc_count_mutex);
+#endif // UW
 
+	pid = proc->p_pid;
 	kfree(proc->p_name);
-	kfree(proc);
+	objcache_put(proc_cache, proc);
 
 #ifdef UW
 	/* decrement the process count */
@@ -177,6 +275,9 @@ proc_destroy(struct proc *proc)
 	P(proc_count_mutex); 
 	KASSERT(proc_count > 0);
 	proc_count--;
+	if (pid != 0) {
+		bitmap_unmark(pid_inuse, pid);
+	}
 	/* signal the kernel menu thread if the process count has reached zero */
 	if (proc_count == 0) {
 	  V(no_proc_sem);
@@ -193,6 +294,11 @@ proc_destroy(struct proc *proc)
 void
 proc_bootstrap(void)
 {
+  proc_cache = objcache_create("proc", sizeof(struct proc), PROC_CACHE_DEPTH,
+			       proc_ctor, proc_dtor);
+  if (proc_cache == NULL) {
+    panic("could not create proc cache\n");
+  }
   kproc = proc_create("[kernel]");
   if (kproc == NULL) {
     panic("proc_create for kproc failed\n");
@@ -207,6 +313,10 @@ proc_bootstrap(void)
   if (no_proc_sem == NULL) {
     panic("could not create no_proc_sem semaphore\n");
   }
+  pid_inuse = bitmap_create(PID_MAX + 1);
+  if (pid_inuse == NULL) {
+    panic("could not create pid bitmap\n");
+  }
 #endif // UW 
 }
 
@@ -268,12 +378,89 @@ proc_create_runprogram(const char *name)
            are created using a call to proc_create_runprogram  */
 	P(proc_count_mutex); 
 	proc_count++;
+	proc_nforks++;
+	proc->p_pid = pid_alloc();
+	if (proc->p_pid != 0) {
+		proc->p_nextproc = allprocs;
+		if (allprocs != NULL) {
+			allprocs->p_prevproc = proc;
+		}
+		allprocs = proc;
+	}
 	V(proc_count_mutex);
+	if (proc->p_pid == 0) {
+		/* every pid is held by a live process */
+		proc_destroy(proc);
+		return NULL;
+	}
 #endif // UW
 
 	return proc;
 }
 
+/*
+ * Number of user processes created since boot, for statistics.
+ */
+unsigned
+proc_forkcount(void)
+{
+	return proc_nforks;
+}
+
+/*
+ * Number of those that reused a cached proc structure.
+ */
+unsigned
+proc_forksaved(void)
+{
+	return proc_nsaved;
+}
+
+/*
+ * Call FUNC on every user process. Holding proc_count_mutex keeps
+ * any from being created or destroyed.
+ */
+void
+proc_foreach(void (*func)(struct proc *proc, void *data), void *data)
+{
+#ifdef UW
+	struct proc *proc;
+
+	P(proc_count_mutex);
+	for (proc = allprocs; proc != NULL; proc = proc->p_nextproc) {
+		func(proc, data);
+	}
+	V(proc_count_mutex);
+#else
+	(void)func;
+	(void)data;
+#endif // UW
+}
+
+/*
+ * Called when a process created by vfork has stopped using its
+ * parent's address space, because it has exec'd or is exiting: wake
+ * the parent up. Does nothing for any other process.
+ *
+ * The caller must already have switched to its own address space (or
+ * to none), since the parent may start running in the borrowed one
+ * right away.
+ */
+void
+proc_vforkdone(struct proc *proc)
+{
+	struct semaphore *sem;
+
+	spinlock_acquire(&proc->p_lock);
+	sem = proc->p_vforksem;
+	proc->p_vforksem = NULL;
+	spinlock_release(&proc->p_lock);
+
+	if (sem != NULL) {
+		V(sem);
+	}
+}
+
 /*
  * Add a thread to a process. Either the thread or the process might
  * or might not be current.
@@ -42,6 +42,7 @@
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <wchan.h>
 #include <vm.h>
 #include <mainbus.h>
 #include <vfs.h>
@@ -50,6 +51,10 @@
 #include <test.h>
 #include <version.h>
 #include "autoconf.h"  // for pseudoconfig
+#include "opt-dumbvm.h"
+#if !OPT_DUMBVM
+#include <uw-vmstats.h>
+#endif
 
 
 /*
@@ -107,6 +112,8 @@ boot(void)
 
 	/* Early initialization. */
 	ram_bootstrap();
+	wchan_bootstrap();
+	synch_bootstrap();
 	proc_bootstrap();
 	thread_bootstrap();
 	hardclock_bootstrap();
@@ -151,6 +158,11 @@ shutdown(void)
 	vfs_clearcurdir();
 	vfs_unmountall();
 
+#if !OPT_DUMBVM
+	vmstats_print();
+	vm_printstats();
+#endif
+
 	thread_shutdown();
 
 	splhigh();
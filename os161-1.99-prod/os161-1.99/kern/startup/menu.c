@@ -41,10 +41,16 @@
 #include <vfs.h>
 #include <sfs.h>
 #include <syscall.h>
+#include <vm.h>
+#include <faultstat.h>
+#include <objcache.h>
+#include <kheapprof.h>
 #include <test.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-dumbvm.h"
+#include "opt-kheapprof.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -402,14 +408,142 @@ static
 int
 cmd_kheapstats(int nargs, char **args)
 {
+	unsigned procsaved, threadsaved, nforks;
+
 	(void)nargs;
 	(void)args;
 
 	kheap_printstats();
+	objcache_printstats();
+
+	/* Only the proc and thread reuses in the fork path count here. */
+	procsaved = proc_forksaved();
+	threadsaved = thread_forksaved();
+	nforks = proc_forkcount();
+	if (nforks > 0) {
+		kprintf("%u of %u forks reused a proc, %u reused a thread\n",
+			procsaved, nforks, threadsaved);
+	}
 	
 	return 0;
 }
 
+#if OPT_KHEAPPROF
+/*
+ * Command for the heap profiler: top allocators, and what grew since
+ * the last time.
+ */
+static
+int
+cmd_kheapprof(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kheapprof_report();
+	return 0;
+}
+#endif
+
+#if !OPT_DUMBVM
+/*
+ * Command for choosing the TLB replacement policy. Usually given on
+ * the boot command line, before any programs run.
+ */
+static
+int
+cmd_tlbpolicy(int nargs, char **args)
+{
+	int result;
+
+	if (nargs != 2) {
+		kprintf("Usage: tlbp rr|random|nru\n");
+		kprintf("Current policy: %s\n", vm_tlb_policyname());
+		return EINVAL;
+	}
+
+	result = vm_tlb_setpolicy(args[1]);
+	if (result) {
+		kprintf("Unknown TLB policy %s\n", args[1]);
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Command for turning TLB address space ids on or off. With them off
+ * the TLB is flushed on every context switch, as it used to be; run
+ * the same workload both ways and compare the TLB fault counts in the
+ * statistics printed at shutdown.
+ */
+static
+int
+cmd_tlbasids(int nargs, char **args)
+{
+	if (nargs != 2 ||
+	    (strcmp(args[1], "on") && strcmp(args[1], "off"))) {
+		kprintf("Usage: tlba on|off\n");
+		kprintf("Currently: %s\n", vm_tlb_asids() ? "on" : "off");
+		return EINVAL;
+	}
+
+	vm_tlb_setasids(!strcmp(args[1], "on"));
+	return 0;
+}
+
+/*
+ * Command for setting the fault-around window.
+ */
+static
+int
+cmd_faultaround(int nargs, char **args)
+{
+	int result;
+
+	if (nargs != 2) {
+		kprintf("Usage: fa npages (0-%d)\n", VM_FAULTAROUND_MAX);
+		kprintf("Current window: %u\n", vm_faultaround());
+		return EINVAL;
+	}
+
+	result = vm_setfaultaround(atoi(args[1]));
+	if (result) {
+		kprintf("Window must be at most %d pages\n",
+			VM_FAULTAROUND_MAX);
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Command for printing VM statistics.
+ */
+static
+int
+cmd_vmstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	vm_printstats();
+	return 0;
+}
+
+/*
+ * Command for printing page fault statistics.
+ */
+static
+int
+cmd_faultstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	faultstat_print();
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -451,6 +585,11 @@ static const char *opsmenu[] = {
 	"[sync]    Sync filesystems          ",
 	"[panic]   Intentional panic         ",
 	"[dth]     Debugging messages for threads",
+#if !OPT_DUMBVM
+	"[tlbp]    Set TLB replacement policy",
+	"[tlba]    TLB address space ids     ",
+	"[fa]      Set fault-around window   ",
+#endif
 	"[q]       Quit and shut down        ",
 	NULL
 };
@@ -471,9 +610,12 @@ static const char *testmenu[] = {
 	"[bt]  Bitmap test                   ",
 	"[km1] Kernel malloc test            ",
 	"[km2] kmalloc stress test           ",
+	"[km3] kmalloc throughput test       ",
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tt4] Scheduler latency test        ",
+	"[tt5] Load balance test             ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
@@ -520,6 +662,13 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+#if OPT_KHEAPPROF
+	"[kp] Kernel heap profile            ",
+#endif
+#if !OPT_DUMBVM
+	"[vms] VM stats                      ",
+	"[fs] Page fault stats               ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -562,6 +711,13 @@ static struct {
 	{ "sync",	cmd_sync },
 	{ "panic",	cmd_panic },
 	{ "dth",        cmd_dth },
+#if !OPT_DUMBVM
+	{ "tlbp",	cmd_tlbpolicy },
+	{ "tlba",	cmd_tlbasids },
+	{ "fa",		cmd_faultaround },
+	{ "vms",	cmd_vmstats },
+	{ "fs",		cmd_faultstats },
+#endif
 	{ "q",		cmd_quit },
 	{ "exit",	cmd_quit },
 	{ "halt",	cmd_quit },
@@ -577,18 +733,24 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+#if OPT_KHEAPPROF
+	{ "kp",         cmd_kheapprof },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
 	{ "bt",		bitmaptest },
 	{ "km1",	malloctest },
 	{ "km2",	mallocstress },
+	{ "km3",	mallocthroughput },
 #if OPT_NET
 	{ "net",	nettest },
 #endif
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tt4",	schedtest },
+	{ "tt5",	balancetest },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
@@ -59,6 +59,7 @@
 #include <addrspace.h>
 #include <vnode.h>
 #include <elf.h>
+#include "opt-dumbvm.h"
 
 /*
  * Load a segment at virtual address VADDR. The segment in memory
@@ -73,7 +74,36 @@
  * executable whose load address is in kernel space. If you should
  * change this code to not use uiomove, be sure to check for this case
  * explicitly.
+ *
+ * With our own VM system nothing is read here: the segment is
+ * attached to its region and vm_fault reads each page in the first
+ * time it is touched. as_define_region has already refused regions
+ * outside user space.
  */
+#if !OPT_DUMBVM
+
+static
+int
+load_segment(struct addrspace *as, struct vnode *v,
+	     off_t offset, vaddr_t vaddr,
+	     size_t memsize, size_t filesize,
+	     int is_executable)
+{
+	(void)is_executable;
+
+	if (filesize > memsize) {
+		kprintf("ELF: warning: segment filesize > segment memsize\n");
+		filesize = memsize;
+	}
+
+	DEBUG(DB_EXEC, "ELF: Mapping %lu bytes at 0x%lx\n",
+	      (unsigned long) filesize, (unsigned long) vaddr);
+
+	return as_attach_file(as, v, offset, vaddr, filesize);
+}
+
+#else /* OPT_DUMBVM */
+
 static
 int
 load_segment(struct addrspace *as, struct vnode *v,
@@ -145,6 +175,8 @@ load_segment(struct addrspace *as, struct vnode *v,
 	return result;
 }
 
+#endif /* OPT_DUMBVM */
+
 /*
  * Load an ELF executable user program into the current address space.
  *
@@ -9,6 +9,8 @@
 #include <thread.h>
 #include <addrspace.h>
 #include <copyinout.h>
+#include <synch.h>
+#include <mips/trapframe.h>
 
   /* this implementation of sys__exit does not do anything with the exit code */
   /* this needs to be fixed to get exit() and waitpid() working properly */
@@ -33,7 +35,13 @@ void sys__exit(int exitcode) {
    * messily fatal.
    */
   as = curproc_setas(NULL);
-  as_destroy(as);
+  if (p->p_vforksem != NULL) {
+    /* the address space is our parent's (vfork); give it back */
+    proc_vforkdone(p);
+  }
+  else {
+    as_destroy(as);
+  }
 
   /* detach this thread from its process */
   /* note: curproc cannot be used after this call */
@@ -49,16 +57,135 @@ void sys__exit(int exitcode) {
 }
 
 
-/* stub handler for getpid() system call                */
+/* handler for getpid() system call                */
 int
 sys_getpid(pid_t *retval)
 {
-  /* for now, this is just a stub that always returns a PID of 1 */
-  /* you need to fix this to make it work properly */
-  *retval = 1;
+  *retval = curproc->p_pid;
+  return(0);
+}
+
+/* the new process of a fork or vfork starts here */
+static
+void
+fork_entry(void *tf, unsigned long unused)
+{
+  (void)unused;
+  enter_forked_process(tf);
+}
+
+/*
+ * Start a child process running in AS, returning from the system
+ * call in TF with 0, and put its pid in *RETVAL. VFORKSEM is set as
+ * its p_vforksem (see sys_vfork), or NULL for fork. On failure AS
+ * and VFORKSEM are left to the caller.
+ */
+static
+int
+fork_child(struct trapframe *tf, struct addrspace *as,
+           struct semaphore *vforksem, pid_t *retval)
+{
+  struct proc *child;
+  struct trapframe *childtf;
+  pid_t pid;
+  int result;
+
+  child = proc_create_runprogram(curproc->p_name);
+  if (child == NULL) {
+    return(ENOMEM);
+  }
+  childtf = kmalloc(sizeof(*childtf));
+  if (childtf == NULL) {
+    proc_destroy(child);
+    return(ENOMEM);
+  }
+  *childtf = *tf;
+
+  /* we don't take the child's p_lock; nothing else can see it yet */
+  child->p_addrspace = as;
+  child->p_vforksem = vforksem;
+
+  /* the child may be gone by the time thread_fork returns */
+  pid = child->p_pid;
+
+  result = thread_fork(curthread->t_name, child, fork_entry, childtf, 0);
+  if (result) {
+    /* proc_destroy leaves the address space to sys__exit */
+    child->p_addrspace = NULL;
+    child->p_vforksem = NULL;
+    kfree(childtf);
+    proc_destroy(child);
+    return(result);
+  }
+
+  *retval = pid;
+  return(0);
+}
+
+/*
+ * handler for fork() system call
+ *
+ * The child gets a copy of our address space (copy-on-write; see
+ * as_copy) and returns 0 from the same system call we return its pid
+ * from.
+ */
+int
+sys_fork(struct trapframe *tf, pid_t *retval)
+{
+  struct addrspace *as;
+  int result;
+
+  DEBUG(DB_SYSCALL,"Syscall: fork()\n");
+
+  KASSERT(curproc->p_addrspace != NULL);
+
+  result = as_copy(curproc->p_addrspace, &as);
+  if (result) {
+    return(result);
+  }
+  result = fork_child(tf, as, NULL, retval);
+  if (result) {
+    as_destroy(as);
+    return(result);
+  }
   return(0);
 }
 
+/*
+ * handler for vfork() system call
+ *
+ * The child runs in our address space instead of a copy of it, and we
+ * sleep until it calls execv or _exit, so the two are never running
+ * in it at once. This saves the as_copy that fork would do, which is
+ * wasted when the child is about to exec anyway.
+ *
+ * As with any vfork, the child must not return from the function that
+ * called vfork, or change anything its parent cares about, before it
+ * execs or exits: whatever it does to memory, the parent will see.
+ */
+int
+sys_vfork(struct trapframe *tf, pid_t *retval)
+{
+  struct semaphore *done;
+  int result;
+
+  DEBUG(DB_SYSCALL,"Syscall: vfork()\n");
+
+  KASSERT(curproc->p_addrspace != NULL);
+
+  done = sem_create("vfork", 0);
+  if (done == NULL) {
+    return(ENOMEM);
+  }
+  result = fork_child(tf, curproc->p_addrspace, done, retval);
+  if (result == 0) {
+    /* wait for the child to exec or exit; see proc_vforkdone */
+    P(done);
+  }
+  sem_destroy(done);
+  return(result);
+}
+
 /* stub handler for waitpid() system call                */
 
 int
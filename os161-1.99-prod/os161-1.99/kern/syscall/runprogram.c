@@ -44,6 +44,8 @@
 #include <vfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <exectrace.h>
+#include "opt-dumbvm.h"
 
 /*
  * Load program "progname" and start running it in usermode.
@@ -87,6 +89,11 @@ runprogram(char *progname)
 		return result;
 	}
 
+#if !OPT_DUMBVM
+	/* Read in what the program used last time, and record this run. */
+	exectrace_exec(as, v);
+#endif
+
 	/* Done with the file now. */
 	vfs_close(v);
 
@@ -0,0 +1,118 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/mman.h>
+#include <kern/faultstat.h>
+#include <lib.h>
+#include <copyinout.h>
+#include <syscall.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <faultstat.h>
+
+/* handler for sbrk() system call                   */
+/*
+ * Moves the break of the current address space by any number of
+ * bytes; the new pages are zero-filled when first touched.
+ */
+
+int
+sys_sbrk(intptr_t amount, vaddr_t *retval)
+{
+  struct addrspace *as;
+
+  DEBUG(DB_SYSCALL,"Syscall: sbrk(%ld)\n",(long)amount);
+
+  as = curproc_getas();
+  KASSERT(as != NULL);
+
+  return as_sbrk(as, amount, retval);
+}
+
+/* Region permissions for the PROT_* bits PROT. */
+static int
+mmap_perms(int prot)
+{
+  return ((prot & PROT_READ) ? VR_READ : 0) |
+    ((prot & PROT_WRITE) ? VR_WRITE : 0) |
+    ((prot & PROT_EXEC) ? VR_EXEC : 0);
+}
+
+/* handler for mmap() system call                   */
+/*
+ * Only anonymous private mappings are supported: there is no
+ * per-process file table yet, so no descriptor could name a file to
+ * map. The descriptor and offset arguments (on the user stack) are
+ * ignored. Returns the address of the mapping.
+ */
+
+int
+sys_mmap(userptr_t addr, size_t len, int prot, int flags, vaddr_t *retval)
+{
+  struct addrspace *as;
+
+  DEBUG(DB_SYSCALL,"Syscall: mmap(%p, %lu, 0x%x, 0x%x)\n",
+        addr, (unsigned long)len, prot, flags);
+
+  as = curproc_getas();
+  KASSERT(as != NULL);
+
+  if ((prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC)) != 0) {
+    return EINVAL;
+  }
+  if ((flags & MAP_ANON) == 0) {
+    /* File mappings need a file table to look the descriptor up in. */
+    return ENODEV;
+  }
+  if ((flags & (MAP_SHARED | MAP_PRIVATE)) != MAP_PRIVATE) {
+    /* Anonymous shared memory would need sharing across fork. */
+    return EINVAL;
+  }
+
+  return as_mmap(as, (vaddr_t)addr, len, mmap_perms(prot),
+                 (flags & MAP_FIXED) != 0, retval);
+}
+
+/* handler for munmap() system call                   */
+
+int
+sys_munmap(userptr_t addr, size_t len)
+{
+  DEBUG(DB_SYSCALL,"Syscall: munmap(%p, %lu)\n",addr,(unsigned long)len);
+
+  return as_munmap(curproc_getas(), (vaddr_t)addr, len);
+}
+
+/* handler for mprotect() system call                   */
+
+int
+sys_mprotect(userptr_t addr, size_t len, int prot)
+{
+  DEBUG(DB_SYSCALL,"Syscall: mprotect(%p, %lu, 0x%x)\n",
+        addr,(unsigned long)len,prot);
+
+  if ((prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC)) != 0) {
+    return EINVAL;
+  }
+  return as_mprotect(curproc_getas(), (vaddr_t)addr, len, mmap_perms(prot));
+}
+
+/* handler for faultstat() system call                   */
+/*
+ * Copies out page fault statistics: the caller's own, one cpu's, or
+ * the system's; see <kern/faultstat.h>.
+ */
+int
+sys_faultstat(int which, userptr_t buf)
+{
+  struct faultstat fs;
+  int result;
+
+  DEBUG(DB_SYSCALL,"Syscall: faultstat(%d, %p)\n",which,buf);
+
+  result = faultstat_get(which, &fs);
+  if (result) {
+    return result;
+  }
+  return copyout(&fs, buf, sizeof(fs));
+}
@@ -32,6 +32,9 @@
  */
 #include <types.h>
 #include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <current.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
@@ -137,3 +140,115 @@ mallocstress(int nargs, char **args)
 
 	return 0;
 }
+
+/*
+ * kmalloc throughput test: 1, 2, 4, and 8 threads each do KM3_NTRIES
+ * small kmalloc/kfree pairs, keeping a few blocks of mixed sizes
+ * live. Reports allocations per second, and how many cpus the
+ * threads ended up on (they start out on this one and get spread
+ * around as the others go idle).
+ */
+
+#define KM3_NTRIES   4000
+#define KM3_NLIVE    8
+#define KM3_MAXTHREADS 8
+
+static const size_t km3_sizes[KM3_NLIVE] = {
+	16, 40, 100, 200, 24, 64, 500, 32
+};
+
+static unsigned km3_cpu[KM3_MAXTHREADS];
+
+static
+void
+km3thread(void *sm, unsigned long num)
+{
+	struct semaphore *sem = sm;
+	void *live[KM3_NLIVE];
+	unsigned i, slot;
+
+	for (i=0; i<KM3_NLIVE; i++) {
+		live[i] = NULL;
+	}
+
+	for (i=0; i<KM3_NTRIES; i++) {
+		slot = i % KM3_NLIVE;
+		kfree(live[slot]);
+		live[slot] = kmalloc(km3_sizes[slot]);
+		if (live[slot] == NULL) {
+			kprintf("thread %lu: kmalloc returned NULL\n", num);
+			break;
+		}
+	}
+
+	for (i=0; i<KM3_NLIVE; i++) {
+		kfree(live[i]);
+	}
+	km3_cpu[num] = curcpu->c_number;
+	V(sem);
+}
+
+int
+mallocthroughput(int nargs, char **args)
+{
+	struct semaphore *sem;
+	time_t startsecs, endsecs;
+	uint32_t startnsecs, endnsecs;
+	unsigned nthreads, i, j, ncpus, msecs;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	sem = sem_create("km3", 0);
+	if (sem == NULL) {
+		panic("km3: sem_create failed\n");
+	}
+
+	kprintf("Starting kmalloc throughput test (%u cpus)...\n",
+		cpu_count());
+
+	for (nthreads=1; nthreads<=KM3_MAXTHREADS; nthreads*=2) {
+		gettime(&startsecs, &startnsecs);
+		for (i=0; i<nthreads; i++) {
+			result = thread_fork("km3", NULL, km3thread, sem, i);
+			if (result) {
+				panic("km3: thread_fork failed: %s\n",
+				      strerror(result));
+			}
+		}
+		for (i=0; i<nthreads; i++) {
+			P(sem);
+		}
+		gettime(&endsecs, &endnsecs);
+
+		msecs = (endsecs - startsecs) * 1000 +
+			endnsecs / 1000000 - startnsecs / 1000000;
+		if (msecs == 0) {
+			msecs = 1;
+		}
+
+		/* Count the distinct cpus the threads finished on. */
+		ncpus = 0;
+		for (i=0; i<nthreads; i++) {
+			for (j=0; j<i; j++) {
+				if (km3_cpu[j] == km3_cpu[i]) {
+					break;
+				}
+			}
+			if (j == i) {
+				ncpus++;
+			}
+		}
+
+		kprintf("km3: %u threads on %u cpus: %u allocs in %u ms, "
+			"%u allocs/sec\n", nthreads, ncpus,
+			nthreads * KM3_NTRIES, msecs,
+			nthreads * KM3_NTRIES * 1000 / msecs);
+	}
+
+	sem_destroy(sem);
+	kprintf("kmalloc throughput test done\n");
+
+	return 0;
+}
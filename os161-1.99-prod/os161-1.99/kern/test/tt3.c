@@ -32,10 +32,14 @@
  */
 #include <types.h>
 #include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <current.h>
 #include <wchan.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
+#include <lamebus/ltimer.h>
 
 #include "opt-synchprobs.h"
 
@@ -150,17 +154,53 @@ make_sleepalots(int howmany)
 	}
 }
 
+struct matrix {
+	char m[DIM][DIM];
+};
+
+/*
+ * Multiply two random matrices; return the trace of the product.
+ */
+static
+unsigned char
+compute_one(struct matrix *m1, struct matrix *m2, struct matrix *m3)
+{
+	unsigned char tot;
+	int i, j, k;
+	uint32_t rand;
+
+	for (i=0; i<DIM; i++) {
+		for (j=0; j<DIM; j++) {
+			rand = random();
+			m1->m[i][j] = rand >> 16;
+			m2->m[i][j] = rand & 0xffff;
+		}
+	}
+
+	for (i=0; i<DIM; i++) {
+		for (j=0; j<DIM; j++) {
+			tot = 0;
+			for (k=0; k<DIM; k++) {
+				tot += m1->m[i][k] * m2->m[k][j];
+			}
+			m3->m[i][j] = tot;
+		}
+	}
+
+	tot = 0;
+	for (i=0; i<DIM; i++) {
+		tot += m3->m[i][i];
+	}
+	return tot;
+}
+
 static
 void
 compute_thread(void *junk1, unsigned long num)
 {
-	struct matrix {
-		char m[DIM][DIM];
-	};
 	struct matrix *m1, *m2, *m3;
 	unsigned char tot;
-	int i, j, k, m;
-	uint32_t rand;
+	int m;
 
 	(void)junk1;
 
@@ -172,30 +212,7 @@ compute_thread(void *junk1, unsigned long num)
 	KASSERT(m3 != NULL);
 
 	for (m=0; m<COMPUTE_ITERS; m++) {
-
-		for (i=0; i<DIM; i++) {
-			for (j=0; j<DIM; j++) {
-				rand = random();
-				m1->m[i][j] = rand >> 16;
-				m2->m[i][j] = rand & 0xffff;
-			}
-		}
-		
-		for (i=0; i<DIM; i++) {
-			for (j=0; j<DIM; j++) {
-				tot = 0;
-				for (k=0; k<DIM; k++) {
-					tot += m1->m[i][k] * m2->m[k][j];
-				}
-				m3->m[i][j] = tot;
-			}
-		}
-		
-		tot = 0;
-		for (i=0; i<DIM; i++) {
-			tot += m3->m[i][i];
-		}
-
+		tot = compute_one(m1, m2, m3);
 		kprintf("{%lu: %u}", num, (unsigned) tot);
 		thread_yield();
 	}
@@ -266,3 +283,264 @@ threadtest3(int nargs, char **args)
 	}
 	return 0;
 }
+
+/*
+ * Scheduler latency test: some compute threads run flat out while one
+ * "interactive" thread naps for a timer tick at a time, the way the
+ * menu waits for keystrokes. A nap should take at most a tick
+ * (LT_GRANULARITY usec); anything past that is time spent waiting
+ * behind the compute threads for the cpu. Reports that, along with
+ * the matrices the compute threads got through per second, so the
+ * scheduler's tradeoff between responsiveness and throughput shows.
+ */
+
+#define SCHED_NAPS       200
+#define SCHED_MAXHOGS    32
+
+static volatile int hogsdone;
+static unsigned hogwork[SCHED_MAXHOGS];
+
+static
+unsigned
+usecs_since(time_t secs, uint32_t nsecs)
+{
+	time_t nowsecs;
+	uint32_t nownsecs;
+
+	gettime(&nowsecs, &nownsecs);
+	return (nowsecs - secs) * 1000000 + nownsecs / 1000 - nsecs / 1000;
+}
+
+static
+void
+hog_thread(void *junk, unsigned long num)
+{
+	struct matrix *m1, *m2, *m3;
+
+	(void)junk;
+
+	m1 = kmalloc(sizeof(struct matrix));
+	KASSERT(m1 != NULL);
+	m2 = kmalloc(sizeof(struct matrix));
+	KASSERT(m2 != NULL);
+	m3 = kmalloc(sizeof(struct matrix));
+	KASSERT(m3 != NULL);
+
+	while (!hogsdone) {
+		compute_one(m1, m2, m3);
+		hogwork[num]++;
+	}
+
+	kfree(m1);
+	kfree(m2);
+	kfree(m3);
+
+	V(donesem);
+}
+
+static
+void
+napper_thread(void *junk1, unsigned long junk2)
+{
+	time_t secs;
+	uint32_t nsecs;
+	unsigned i, usecs, total, worst;
+
+	(void)junk1;
+	(void)junk2;
+
+	total = worst = 0;
+	for (i=0; i<SCHED_NAPS; i++) {
+		gettime(&secs, &nsecs);
+		clocknap(1);
+		usecs = usecs_since(secs, nsecs);
+		total += usecs;
+		if (usecs > worst) {
+			worst = usecs;
+		}
+	}
+	hogsdone = 1;
+
+	kprintf("tt4: %u naps of one tick (%u usec): average %u usec, "
+		"worst %u usec\n", SCHED_NAPS, LT_GRANULARITY,
+		total / SCHED_NAPS, worst);
+	V(donesem);
+}
+
+int
+schedtest(int nargs, char **args)
+{
+	time_t secs;
+	uint32_t nsecs;
+	unsigned nhogs, i, work, msecs;
+	int result;
+
+	if (nargs == 1) {
+		nhogs = 4;
+	}
+	else if (nargs == 2) {
+		nhogs = atoi(args[1]);
+	}
+	else {
+		kprintf("Usage: tt4 [computethreads]\n");
+		return 1;
+	}
+	if (nhogs > SCHED_MAXHOGS) {
+		nhogs = SCHED_MAXHOGS;
+	}
+
+	setup();
+	hogsdone = 0;
+	for (i=0; i<nhogs; i++) {
+		hogwork[i] = 0;
+	}
+
+	kprintf("Starting scheduler latency test (%u compute threads, "
+		"%u cpus)...\n", nhogs, cpu_count());
+	gettime(&secs, &nsecs);
+	for (i=0; i<nhogs; i++) {
+		result = thread_fork("hog", NULL, hog_thread, NULL, i);
+		if (result) {
+			panic("thread_fork failed: %s\n", strerror(result));
+		}
+	}
+	result = thread_fork("napper", NULL, napper_thread, NULL, 0);
+	if (result) {
+		panic("thread_fork failed: %s\n", strerror(result));
+	}
+	for (i=0; i<nhogs+1; i++) {
+		P(donesem);
+	}
+	msecs = usecs_since(secs, nsecs) / 1000;
+	if (msecs == 0) {
+		msecs = 1;
+	}
+
+	work = 0;
+	for (i=0; i<nhogs; i++) {
+		work += hogwork[i];
+	}
+	kprintf("tt4: %u matrices in %u ms, %u matrices/sec\n",
+		work, msecs, work * 1000 / msecs);
+	kprintf("Scheduler latency test done\n");
+	return 0;
+}
+
+/*
+ * Load balance test: fork tt3's compute threads, all of which start
+ * out on this cpu, and see how long it takes before every cpu is
+ * running one (time to balance) and how many matrices per second
+ * they get through overall. Run it with sys161 configured for 2, 4,
+ * and 8 cpus to compare.
+ */
+
+#define BAL_ITERS        40
+#define BAL_MAXCPUS      32
+#define BAL_MAXTHREADS   64
+
+static time_t bal_secs;
+static uint32_t bal_nsecs;
+static unsigned bal_firstrun[BAL_MAXCPUS];	/* usec, or 0 */
+
+static
+void
+balance_thread(void *junk1, unsigned long junk2)
+{
+	struct matrix *m1, *m2, *m3;
+	unsigned cpunum, i;
+
+	(void)junk1;
+	(void)junk2;
+
+	m1 = kmalloc(sizeof(struct matrix));
+	KASSERT(m1 != NULL);
+	m2 = kmalloc(sizeof(struct matrix));
+	KASSERT(m2 != NULL);
+	m3 = kmalloc(sizeof(struct matrix));
+	KASSERT(m3 != NULL);
+
+	for (i=0; i<BAL_ITERS; i++) {
+		cpunum = curcpu->c_number;
+		if (cpunum < BAL_MAXCPUS && bal_firstrun[cpunum] == 0) {
+			bal_firstrun[cpunum] =
+				usecs_since(bal_secs, bal_nsecs) + 1;
+		}
+		compute_one(m1, m2, m3);
+		thread_yield();
+	}
+
+	kfree(m1);
+	kfree(m2);
+	kfree(m3);
+
+	V(donesem);
+}
+
+int
+balancetest(int nargs, char **args)
+{
+	unsigned ncpus, nthreads, nbusy, balanced, steals, msecs, i;
+	int result;
+
+	ncpus = cpu_count();
+	if (ncpus > BAL_MAXCPUS) {
+		ncpus = BAL_MAXCPUS;
+	}
+
+	if (nargs == 1) {
+		nthreads = 2 * ncpus;
+	}
+	else if (nargs == 2) {
+		nthreads = atoi(args[1]);
+	}
+	else {
+		kprintf("Usage: tt5 [computethreads]\n");
+		return 1;
+	}
+	if (nthreads > BAL_MAXTHREADS) {
+		nthreads = BAL_MAXTHREADS;
+	}
+
+	setup();
+	for (i=0; i<BAL_MAXCPUS; i++) {
+		bal_firstrun[i] = 0;
+	}
+	steals = thread_nsteals();
+
+	kprintf("Starting load balance test (%u compute threads, "
+		"%u cpus)...\n", nthreads, ncpus);
+	gettime(&bal_secs, &bal_nsecs);
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("balance", NULL, balance_thread, NULL, i);
+		if (result) {
+			panic("thread_fork failed: %s\n", strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(donesem);
+	}
+	msecs = usecs_since(bal_secs, bal_nsecs) / 1000;
+	if (msecs == 0) {
+		msecs = 1;
+	}
+	steals = thread_nsteals() - steals;
+
+	/* Balanced when the last cpu to get a compute thread got one. */
+	nbusy = balanced = 0;
+	for (i=0; i<ncpus; i++) {
+		if (bal_firstrun[i] != 0) {
+			nbusy++;
+			if (bal_firstrun[i] > balanced) {
+				balanced = bal_firstrun[i];
+			}
+		}
+	}
+
+	kprintf("tt5: %u of %u cpus used, all of them within %u usec; "
+		"%u threads stolen\n", nbusy, ncpus, balanced, steals);
+	kprintf("tt5: %u matrices in %u ms, %u matrices/sec\n",
+		nthreads * BAL_ITERS, msecs,
+		nthreads * BAL_ITERS * 1000 / msecs);
+	kprintf("Load balance test done\n");
+	return 0;
+}
@@ -243,6 +243,11 @@ vmstats_thread(void *junk, unsigned long num)
             }
             break;
 
+          /* Left at zero, so the sums above still hold */
+          case VMSTAT_TLB_PREFETCH:
+          case VMSTAT_PAGE_FAULT_ZSWAP:
+            break;
+
           default:
             kprintf("Unknown stat %d\n", j);
             break;
@@ -33,12 +33,39 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <objcache.h>
+
+/*
+ * Locks and CVs come from caches, and keep their wait channels while
+ * cached.
+ */
+#define SYNCH_CACHE_DEPTH 16
+static struct objcache *lock_cache;
+static struct objcache *cv_cache;
+
+static int lock_ctor(void *obj);
+static void lock_dtor(void *obj);
+static int cv_ctor(void *obj);
+static void cv_dtor(void *obj);
+
+void
+synch_bootstrap(void)
+{
+        lock_cache = objcache_create("lock", sizeof(struct lock),
+                                     SYNCH_CACHE_DEPTH, lock_ctor, lock_dtor);
+        cv_cache = objcache_create("cv", sizeof(struct cv),
+                                   SYNCH_CACHE_DEPTH, cv_ctor, cv_dtor);
+        if (lock_cache == NULL || cv_cache == NULL) {
+                panic("synch_bootstrap: Out of memory\n");
+        }
+}
 
 ////////////////////////////////////////////////////////////
 //
@@ -147,37 +174,57 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+static
+int
+lock_ctor(void *obj)
+{
+        struct lock *lock = obj;
+
+        // create the wait channel in the lock
+        lock->lk_wchan = wchan_create("lock");
+        if (lock->lk_wchan == NULL) {
+                return ENOMEM;
+        }
+
+        // create the spinlock in the lock
+        spinlock_init(&lock->lk_spinlock);
+
+        // No thread owns this lock when it is created
+        lock->owner = NULL;
+        lock->lk_name = NULL;
+        return 0;
+}
+
+static
+void
+lock_dtor(void *obj)
+{
+        struct lock *lock = obj;
+
+        // destroy the spinlock in the lock
+        spinlock_cleanup(&lock->lk_spinlock);
+
+        // destroy the wait channel in the lock
+        wchan_destroy(lock->lk_wchan);
+}
+
 struct lock *
 lock_create(const char *name)
 {
         struct lock *lock;
 
-        lock = kmalloc(sizeof(struct lock));
+        lock = objcache_get(lock_cache);
         if (lock == NULL) {
                 return NULL;
         }
 
         lock->lk_name = kstrdup(name);
         if (lock->lk_name == NULL) {
-                kfree(lock);
+                objcache_put(lock_cache, lock);
                 return NULL;
         }
-        
-        // create the wait channel in the lock
-        lock->lk_wchan = wchan_create(lock->lk_name);
-        if (lock->lk_wchan == NULL) {
-                kfree(lock->lk_name);
-                kfree(lock);
-                return NULL;
-        }
-        
-        // create the spinlock in the lock
-        spinlock_init(&lock->lk_spinlock);
-        
-        // No thread owns this lock when it is created
-        lock->owner = NULL;
+        wchan_setname(lock->lk_wchan, lock->lk_name);
 
-        
         return lock;
 }
 
@@ -185,17 +232,13 @@ void
 lock_destroy(struct lock *lock)
 {
         KASSERT(lock != NULL);
+        KASSERT(lock->owner == NULL);
+        KASSERT(wchan_isempty(lock->lk_wchan));
 
-        // destroy the spinlock in the lock
-        spinlock_cleanup(&lock->lk_spinlock);
-        
-        // destroy the wait channel in the lock
-        wchan_destroy(lock->lk_wchan);
-        
-        lock->owner = NULL;
-        
+        wchan_setname(lock->lk_wchan, "lock");
         kfree(lock->lk_name);
-        kfree(lock);
+        lock->lk_name = NULL;
+        objcache_put(lock_cache, lock);
 }
 
 void
@@ -260,31 +303,48 @@ lock_do_i_hold(struct lock *lock)
 // CV
 
 
+static
+int
+cv_ctor(void *obj)
+{
+        struct cv *cv = obj;
+
+        cv->cv_wchan = wchan_create("cv");
+        if (cv->cv_wchan == NULL) {
+                return ENOMEM;
+        }
+
+        cv->cv_mutex = NULL;
+        cv->cv_name = NULL;
+        return 0;
+}
+
+static
+void
+cv_dtor(void *obj)
+{
+        struct cv *cv = obj;
+
+        wchan_destroy(cv->cv_wchan);
+}
+
 struct cv *
 cv_create(const char *name)
 {
         struct cv *cv;
 
-        cv = kmalloc(sizeof(struct cv));
+        cv = objcache_get(cv_cache);
         if (cv == NULL) {
                 return NULL;
         }
 
         cv->cv_name = kstrdup(name);
         if (cv->cv_name==NULL) {
-                kfree(cv);
+                objcache_put(cv_cache, cv);
                 return NULL;
         }
-        
-        cv->cv_wchan = wchan_create(cv->cv_name);
-        if (cv->cv_wchan == NULL) {
-                kfree(cv->cv_wchan);
-                kfree(cv);
-                return NULL;
-        }
-        
-        cv->cv_mutex = NULL;
-        
+        wchan_setname(cv->cv_wchan, cv->cv_name);
+
         return cv;
 }
 
@@ -292,11 +352,12 @@ void
 cv_destroy(struct cv *cv)
 {
         KASSERT(cv != NULL);
+        KASSERT(wchan_isempty(cv->cv_wchan));
 
-        wchan_destroy(cv->cv_wchan);
-        
+        wchan_setname(cv->cv_wchan, "cv");
         kfree(cv->cv_name);
-        kfree(cv);
+        cv->cv_name = NULL;
+        objcache_put(cv_cache, cv);
 }
 
 void
@@ -50,6 +50,7 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <objcache.h>
 
 #include "opt-synchprobs.h"
 
@@ -72,6 +73,18 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/*
+ * Caches of thread structures and wait channels. A cached thread
+ * keeps its stack.
+ */
+#define THREAD_CACHE_DEPTH  8
+#define WCHAN_CACHE_DEPTH   32
+static struct objcache *thread_cache;
+static struct objcache *wchan_cache;
+
+/* Reuses of thread_cache by threads of user processes; under its lock. */
+static unsigned thread_nforksaved;
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -111,26 +124,53 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Constructor and destructor for thread_cache. A thread gets a stack
+ * the first time it's forked, and then keeps it.
+ */
+static
+int
+thread_ctor(void *obj)
+{
+	struct thread *thread = obj;
+
+	thread->t_stack = NULL;
+	return 0;
+}
+
+static
+void
+thread_dtor(void *obj)
+{
+	struct thread *thread = obj;
+
+	if (thread->t_stack != NULL) {
+		kfree(thread->t_stack);
+	}
+}
+
 /*
  * Create a thread. This is used both to create a first thread
- * for each CPU and to create subsequent forked threads.
+ * for each CPU and to create subsequent forked threads. If the thread
+ * structure comes from the cache and SAVED is not NULL, *SAVED is
+ * incremented.
  */
 static
 struct thread *
-thread_create(const char *name)
+thread_create(const char *name, unsigned *saved)
 {
 	struct thread *thread;
 
 	DEBUGASSERT(name != NULL);
 
-	thread = kmalloc(sizeof(*thread));
+	thread = objcache_getcount(thread_cache, saved);
 	if (thread == NULL) {
 		return NULL;
 	}
 
 	thread->t_name = kstrdup(name);
 	if (thread->t_name == NULL) {
-		kfree(thread);
+		objcache_put(thread_cache, thread);
 		return NULL;
 	}
 	thread->t_wchan_name = "NEW";
@@ -139,10 +179,12 @@ thread_create(const char *name)
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
+	/* t_stack is kept from the last use, if any */
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
+	thread->t_prio = 0;
+	thread->t_ticks = 0;
 
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
@@ -167,6 +209,7 @@ cpu_create(unsigned hardware_number)
 {
 	struct cpu *c;
 	int result;
+	unsigned i;
 	char namebuf[16];
 
 	c = kmalloc(sizeof(*c));
@@ -180,9 +223,14 @@ cpu_create(unsigned hardware_number)
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
+	c->c_asidgen = 0;
+	c->c_nsteals = 0;
 
 	c->c_isidle = false;
-	threadlist_init(&c->c_runqueue);
+	for (i=0; i<SCHED_NPRIO; i++) {
+		threadlist_init(&c->c_runqueue[i]);
+	}
+	c->c_runcount = 0;
 	spinlock_init(&c->c_runqueue_lock);
 
 	c->c_ipi_pending = 0;
@@ -193,9 +241,10 @@ cpu_create(unsigned hardware_number)
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
+	kmalloc_cpuinit(c->c_number);
 
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
-	c->c_curthread = thread_create(namebuf);
+	c->c_curthread = thread_create(namebuf, NULL);
 	if (c->c_curthread == NULL) {
 		panic("cpu_create: thread_create failed\n");
 	}
@@ -212,9 +261,12 @@ cpu_create(unsigned hardware_number)
 		 * make it possible to free the boot stack?)
 		 */
 		/*c->c_curthread->t_stack = ... */
+		KASSERT(c->c_curthread->t_stack == NULL);
 	}
 	else {
-		c->c_curthread->t_stack = kmalloc(STACK_SIZE);
+		if (c->c_curthread->t_stack == NULL) {
+			c->c_curthread->t_stack = kmalloc(STACK_SIZE);
+		}
 		if (c->c_curthread->t_stack == NULL) {
 			panic("cpu_create: couldn't allocate stack");
 		}
@@ -227,6 +279,12 @@ cpu_create(unsigned hardware_number)
 	return c;
 }
 
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
 /*
  * Destroy a thread.
  *
@@ -249,9 +307,7 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
-	if (thread->t_stack != NULL) {
-		kfree(thread->t_stack);
-	}
+	/* The stack stays with the structure; see thread_dtor. */
 	threadlistnode_cleanup(&thread->t_listnode);
 	thread_machdep_cleanup(&thread->t_machdep);
 
@@ -259,7 +315,7 @@ thread_destroy(struct thread *thread)
 	thread->t_wchan_name = "DESTROYED";
 
 	kfree(thread->t_name);
-	kfree(thread);
+	objcache_put(thread_cache, thread);
 }
 
 /*
@@ -289,6 +345,8 @@ exorcise(void)
 void
 thread_panic(void)
 {
+	unsigned i;
+
 	/*
 	 * Kill off other CPUs.
 	 *
@@ -303,9 +361,12 @@ thread_panic(void)
 	 * to.  Instead, blat the list structure by hand, and take the
 	 * risk that it might not be quite atomic.
 	 */
-	curcpu->c_runqueue.tl_count = 0;
-	curcpu->c_runqueue.tl_head.tln_next = NULL;
-	curcpu->c_runqueue.tl_tail.tln_prev = NULL;
+	for (i=0; i<SCHED_NPRIO; i++) {
+		curcpu->c_runqueue[i].tl_count = 0;
+		curcpu->c_runqueue[i].tl_head.tln_next = NULL;
+		curcpu->c_runqueue[i].tl_tail.tln_prev = NULL;
+	}
+	curcpu->c_runcount = 0;
 
 	/*
 	 * Ideally, we want to make sure sleeping threads don't wake
@@ -351,6 +412,13 @@ thread_bootstrap(void)
 
 	cpuarray_init(&allcpus);
 
+	thread_cache = objcache_create("thread", sizeof(struct thread),
+				       THREAD_CACHE_DEPTH,
+				       thread_ctor, thread_dtor);
+	if (thread_cache == NULL) {
+		panic("thread_bootstrap: Out of memory\n");
+	}
+
 	/*
 	 * Create the cpu structure for the bootup CPU, the one we're
 	 * currently running on. Assume the hardware number is 0; that
@@ -426,6 +494,73 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Run queue operations. There is one queue per priority level; a
+ * thread goes on the one for its t_prio. Call with the cpu's run
+ * queue lock held.
+ */
+static
+void
+runq_add(struct cpu *c, struct thread *t)
+{
+	KASSERT(t->t_prio < SCHED_NPRIO);
+	threadlist_addtail(&c->c_runqueue[t->t_prio], t);
+	c->c_runcount++;
+}
+
+/*
+ * Highest priority with a thread waiting, or SCHED_NPRIO if none.
+ */
+static
+unsigned
+runq_best(struct cpu *c)
+{
+	unsigned i;
+
+	for (i=0; i<SCHED_NPRIO; i++) {
+		if (!threadlist_isempty(&c->c_runqueue[i])) {
+			break;
+		}
+	}
+	return i;
+}
+
+/*
+ * Take the next thread to run: the oldest one at the highest priority.
+ */
+static
+struct thread *
+runq_remhead(struct cpu *c)
+{
+	unsigned i;
+
+	i = runq_best(c);
+	if (i == SCHED_NPRIO) {
+		return NULL;
+	}
+	c->c_runcount--;
+	return threadlist_remhead(&c->c_runqueue[i]);
+}
+
+/*
+ * Take the thread that would run last: the newest one at the lowest
+ * priority.
+ */
+static
+struct thread *
+runq_remtail(struct cpu *c)
+{
+	unsigned i;
+
+	for (i=SCHED_NPRIO; i-- > 0; ) {
+		if (!threadlist_isempty(&c->c_runqueue[i])) {
+			c->c_runcount--;
+			return threadlist_remtail(&c->c_runqueue[i]);
+		}
+	}
+	return NULL;
+}
+
 /*
  * Make a thread runnable.
  *
@@ -450,7 +585,7 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 
 	isidle = targetcpu->c_isidle;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	runq_add(targetcpu, target);
 	if (isidle) {
 		/*
 		 * Other processor is idle; send interrupt to make
@@ -487,13 +622,20 @@ thread_fork(const char *name,
 	DEBUG(DB_THREADS,"Forking thread: %s\n",name);
 #endif // UW
 
-	newthread = thread_create(name);
+	if (proc == NULL) {
+		proc = curthread->t_proc;
+	}
+
+	newthread = thread_create(name,
+				  proc == kproc ? NULL : &thread_nforksaved);
 	if (newthread == NULL) {
 		return ENOMEM;
 	}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
+	/* Allocate a stack, unless it has one from last time */
+	if (newthread->t_stack == NULL) {
+		newthread->t_stack = kmalloc(STACK_SIZE);
+	}
 	if (newthread->t_stack == NULL) {
 		thread_destroy(newthread);
 		return ENOMEM;
@@ -508,9 +650,6 @@ thread_fork(const char *name,
 	newthread->t_cpu = curthread->t_cpu;
 
 	/* Attach the new thread to its process */
-	if (proc == NULL) {
-		proc = curthread->t_proc;
-	}
 	result = proc_addthread(proc, newthread);
 	if (result) {
 		/* thread_destroy will clean up the stack */
@@ -534,6 +673,105 @@ thread_fork(const char *name,
 	return 0;
 }
 
+/*
+ * Work stealing. Called by an idle cpu, without its own run queue
+ * lock, to take a thread from the cpu with the most threads waiting.
+ * The victim is picked by reading c_runcount without locking; that's
+ * only a hint, so it's checked again under the victim's lock. Only
+ * one run queue lock is held at a time, so two cpus stealing from
+ * each other can't deadlock.
+ *
+ * This is the only way threads move between cpus: busy cpus never
+ * push work away, so a thread can't be handed back and forth by a
+ * push from one side and a steal from the other.
+ *
+ * We take the thread that would run last on the victim (lowest
+ * priority, most recently queued), which is the least likely to have
+ * anything left in the victim's cache. It goes on our own run queue.
+ *
+ * Returns true if we got one.
+ */
+static
+bool
+thread_steal(void)
+{
+	struct cpu *c, *victim;
+	struct thread *t;
+	unsigned i, numcpus, load, maxload;
+
+	victim = NULL;
+	maxload = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		load = c->c_runcount;
+		if (c != curcpu->c_self && load > maxload) {
+			victim = c;
+			maxload = load;
+		}
+	}
+	if (victim == NULL) {
+		return false;
+	}
+
+	spinlock_acquire(&victim->c_runqueue_lock);
+	t = runq_remtail(victim);
+	if (t != NULL &&
+	    (t == victim->c_curthread || t == curthread)) {
+		/*
+		 * A thread can be on a run queue while still
+		 * running: if it went to sleep, its cpu went idle
+		 * with it still curthread, and it was woken before
+		 * the cpu got going again. Moving it then could let
+		 * two cpus run it at once. Leave it be.
+		 */
+		runq_add(victim, t);
+		t = NULL;
+	}
+	if (t != NULL) {
+		t->t_cpu = curcpu->c_self;
+	}
+	spinlock_release(&victim->c_runqueue_lock);
+
+	if (t == NULL) {
+		return false;
+	}
+
+	DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u",
+	      t->t_name, victim->c_number, curcpu->c_number);
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	runq_add(curcpu, t);
+	spinlock_release(&curcpu->c_runqueue_lock);
+	curcpu->c_nsteals++;
+	return true;
+}
+
+/*
+ * Number of threads forked into user processes that reused a cached
+ * thread structure. For statistics.
+ */
+unsigned
+thread_forksaved(void)
+{
+	return thread_nforksaved;
+}
+
+/*
+ * Total number of threads stolen, over all cpus. For statistics.
+ */
+unsigned
+thread_nsteals(void)
+{
+	unsigned i, n;
+
+	n = 0;
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		n += cpuarray_get(&allcpus, i)->c_nsteals;
+	}
+	return n;
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -573,8 +811,12 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	/*
+	 * Micro-optimization: if nothing to do, just return. That
+	 * includes yielding when everything waiting is of lower
+	 * priority, since we'd be picked again anyway.
+	 */
+	if (newstate == S_READY && runq_best(curcpu) > cur->t_prio) {
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
@@ -613,7 +855,8 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	cur->t_state = newstate;
 
 	/*
-	 * Get the next thread. While there isn't one, call md_idle().
+	 * Get the next thread. While there isn't one, try to steal one
+	 * from another cpu, and failing that call md_idle().
 	 * curcpu->c_isidle must be true when md_idle is
 	 * called. Unlock the runqueue while idling too, to make sure
 	 * things can be added to it.
@@ -632,10 +875,16 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
 	do {
-		next = threadlist_remhead(&curcpu->c_runqueue);
+		next = runq_remhead(curcpu);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			/*
+			 * Take someone else's work, or do some VM
+			 * housekeeping instead, if there is any.
+			 */
+			if (!thread_steal() && !vm_idle()) {
+				cpu_idle();
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
@@ -822,139 +1071,77 @@ thread_yield(void)
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * This is a multilevel feedback queue. Each cpu has a run queue per
+ * priority, and runs the threads at the highest priority that has any
+ * round-robin. A thread's quantum, counted in hardclocks, doubles at
+ * each level down. New threads start at the top; a thread that uses
+ * up its quantum drops a level, and one that sleeps before using half
+ * of it goes back up a level when woken. So threads that compute for
+ * a long time sink, and threads that mostly wait for something (the
+ * console, the disk, another thread) stay up and get the cpu soon
+ * after they wake.
+ *
+ * A thread keeps its t_ticks across sleeps and preemptions, so
+ * sleeping just before the quantum runs out doesn't keep a hog at the
+ * top. To make sure nothing starves and that threads whose behaviour
+ * changes get another chance, schedule() periodically moves every
+ * thread back to the top.
  */
 
-void
-schedule(void)
-{
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
-}
+static const unsigned sched_quantum[SCHED_NPRIO] = { 1, 2, 4, 8 };
 
-/*
- * Thread migration.
- *
- * This is also called periodically from hardclock(). If the current
- * CPU is busy and other CPUs are idle, or less busy, it should move
- * threads across to those other other CPUs.
- *
- * Migrating threads isn't free because of cache affinity; a thread's
- * working cache set will end up having to be moved to the other CPU,
- * which is fairly slow. The tradeoff between this performance loss
- * and the performance loss due to underutilization of some CPUs is
- * something that needs to be tuned and probably is workload-specific.
- *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
- */
-void
-thread_consider_migration(void)
+bool
+thread_tick(void)
 {
-	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
-	struct cpu *c;
-	struct threadlist victims;
-	struct thread *t;
+	struct thread *cur;
+	unsigned best;
 
-	my_count = total_count = 0;
-	numcpus = cpuarray_num(&allcpus);
-	for (i=0; i<numcpus; i++) {
-		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
-		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
-		}
-		spinlock_release(&c->c_runqueue_lock);
+	cur = curthread;
+
+	/* When idle, curthread isn't really running. */
+	if (curcpu->c_isidle) {
+		return false;
 	}
 
-	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
-		return;
+	cur->t_ticks++;
+	if (cur->t_ticks >= sched_quantum[cur->t_prio]) {
+		if (cur->t_prio < SCHED_NPRIO - 1) {
+			cur->t_prio++;
+		}
+		cur->t_ticks = 0;
+		return true;
 	}
 
-	to_send = my_count - one_share;
-	threadlist_init(&victims);
 	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
-	}
+	best = runq_best(curcpu);
 	spinlock_release(&curcpu->c_runqueue_lock);
+	return best < cur->t_prio;
+}
 
-	for (i=0; i < numcpus && to_send > 0; i++) {
-		c = cpuarray_get(&allcpus, i);
-		if (c == curcpu->c_self) {
-			continue;
-		}
-		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
+/*
+ * This is called periodically from hardclock(). It boosts all the
+ * threads on the current cpu back to the top priority.
+ */
+void
+schedule(void)
+{
+	struct thread *t;
+	unsigned i;
 
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
-			if (c->c_isidle) {
-				/*
-				 * Other processor is idle; send
-				 * interrupt to make sure it unidles.
-				 */
-				ipi_send(c, IPI_UNIDLE);
-			}
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	for (i=1; i<SCHED_NPRIO; i++) {
+		while ((t = threadlist_remhead(&curcpu->c_runqueue[i])) != NULL) {
+			t->t_prio = 0;
+			t->t_ticks = 0;
+			threadlist_addtail(&curcpu->c_runqueue[0], t);
 		}
-		spinlock_release(&c->c_runqueue_lock);
 	}
+	spinlock_release(&curcpu->c_runqueue_lock);
 
-	/*
-	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
-	 */
-	if (!threadlist_isempty(&victims)) {
-		spinlock_acquire(&curcpu->c_runqueue_lock);
-		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
-		}
-		spinlock_release(&curcpu->c_runqueue_lock);
+	if (!curcpu->c_isidle) {
+		curthread->t_prio = 0;
+		curthread->t_ticks = 0;
 	}
-
-	KASSERT(threadlist_isempty(&victims));
-	threadlist_cleanup(&victims);
 }
 
 ////////////////////////////////////////////////////////////
@@ -971,17 +1158,52 @@ thread_consider_migration(void)
  * arrangements should be made to free it after the wait channel is
  * destroyed.
  */
+static
+int
+wchan_ctor(void *obj)
+{
+	struct wchan *wc = obj;
+
+	spinlock_init(&wc->wc_lock);
+	threadlist_init(&wc->wc_threads);
+	wc->wc_name = NULL;
+	return 0;
+}
+
+static
+void
+wchan_dtor(void *obj)
+{
+	struct wchan *wc = obj;
+
+	spinlock_cleanup(&wc->wc_lock);
+	threadlist_cleanup(&wc->wc_threads);
+}
+
+/*
+ * Set up the wait channel cache. Called early in boot, before anything
+ * makes a wait channel.
+ */
+void
+wchan_bootstrap(void)
+{
+	wchan_cache = objcache_create("wchan", sizeof(struct wchan),
+				      WCHAN_CACHE_DEPTH,
+				      wchan_ctor, wchan_dtor);
+	if (wchan_cache == NULL) {
+		panic("wchan_bootstrap: Out of memory\n");
+	}
+}
+
 struct wchan *
 wchan_create(const char *name)
 {
 	struct wchan *wc;
 
-	wc = kmalloc(sizeof(*wc));
+	wc = objcache_get(wchan_cache);
 	if (wc == NULL) {
 		return NULL;
 	}
-	spinlock_init(&wc->wc_lock);
-	threadlist_init(&wc->wc_threads);
 	wc->wc_name = name;
 	return wc;
 }
@@ -993,9 +1215,19 @@ wchan_create(const char *name)
 void
 wchan_destroy(struct wchan *wc)
 {
-	spinlock_cleanup(&wc->wc_lock);
-	threadlist_cleanup(&wc->wc_threads);
-	kfree(wc);
+	KASSERT(threadlist_isempty(&wc->wc_threads));
+	KASSERT(!spinlock_do_i_hold(&wc->wc_lock));
+	wc->wc_name = NULL;
+	objcache_put(wchan_cache, wc);
+}
+
+/*
+ * Rename a wait channel.
+ */
+void
+wchan_setname(struct wchan *wc, const char *name)
+{
+	wc->wc_name = name;
 }
 
 /*
@@ -1028,6 +1260,22 @@ wchan_sleep(struct wchan *wc)
 	thread_switch(S_SLEEP, wc);
 }
 
+/*
+ * Make a thread that was sleeping on a wait channel runnable. If it
+ * went to sleep without using half its quantum, move it up a level.
+ */
+static
+void
+thread_wakeup(struct thread *target)
+{
+	if (target->t_prio > 0 &&
+	    target->t_ticks < sched_quantum[target->t_prio] / 2) {
+		target->t_prio--;
+		target->t_ticks = 0;
+	}
+	thread_make_runnable(target, false);
+}
+
 /*
  * Wake up one thread sleeping on a wait channel.
  */
@@ -1050,7 +1298,7 @@ wchan_wakeone(struct wchan *wc)
 		return;
 	}
 
-	thread_make_runnable(target, false);
+	thread_wakeup(target);
 }
 
 /*
@@ -1084,7 +1332,7 @@ wchan_wakeall(struct wchan *wc)
 	 * make each thread runnable.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
-		thread_make_runnable(target, false);
+		thread_wakeup(target);
 	}
 
 	threadlist_cleanup(&list);
@@ -1140,20 +1388,30 @@ ipi_broadcast(int code)
 	}
 }
 
+/*
+ * Queue N mappings for TARGET and send it one IPI for all of them. If
+ * they don't fit in its queue, it flushes everything instead.
+ */
+static
 void
-ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
+ipi_tlbshootdown_batch(struct cpu *target, const struct tlbshootdown *mappings,
+		       unsigned n)
 {
-	int n;
+	unsigned i;
+	int num;
 
 	spinlock_acquire(&target->c_ipi_lock);
 
-	n = target->c_numshootdown;
-	if (n == TLBSHOOTDOWN_MAX) {
+	num = target->c_numshootdown;
+	if (num == TLBSHOOTDOWN_ALL ||
+	    n > (unsigned)(TLBSHOOTDOWN_MAX - num)) {
 		target->c_numshootdown = TLBSHOOTDOWN_ALL;
 	}
 	else {
-		target->c_shootdown[n] = *mapping;
-		target->c_numshootdown = n+1;
+		for (i=0; i<n; i++) {
+			target->c_shootdown[num + i] = mappings[i];
+		}
+		target->c_numshootdown = num + n;
 	}
 
 	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
@@ -1162,11 +1420,38 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 	spinlock_release(&target->c_ipi_lock);
 }
 
+void
+ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
+{
+	ipi_tlbshootdown_batch(target, mapping, 1);
+}
+
+unsigned
+ipi_tlbshootdown_cpus(uint32_t cpumask, const struct tlbshootdown *mappings,
+		      unsigned n)
+{
+	unsigned i, ncpus;
+	struct cpu *c;
+
+	ncpus = 0;
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == curcpu->c_self) {
+			continue;
+		}
+		if ((cpumask & ((uint32_t)1 << c->c_number)) == 0) {
+			continue;
+		}
+		ipi_tlbshootdown_batch(c, mappings, n);
+		ncpus++;
+	}
+	return ncpus;
+}
+
 void
 interprocessor_interrupt(void)
 {
 	uint32_t bits;
-	int i;
 
 	spinlock_acquire(&curcpu->c_ipi_lock);
 	bits = curcpu->c_ipi_pending;
@@ -1197,9 +1482,8 @@ interprocessor_interrupt(void)
 			vm_tlbshootdown_all();
 		}
 		else {
-			for (i=0; i<curcpu->c_numshootdown; i++) {
-				vm_tlbshootdown(&curcpu->c_shootdown[i]);
-			}
+			vm_tlbshootdown(curcpu->c_shootdown,
+					curcpu->c_numshootdown);
 		}
 		curcpu->c_numshootdown = 0;
 	}
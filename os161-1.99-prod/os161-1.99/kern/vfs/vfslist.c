@@ -43,6 +43,8 @@
 #include <fs.h>
 #include <vnode.h>
 #include <device.h>
+#include <exectrace.h>
+#include "opt-dumbvm.h"
 
 /*
  * Structure for a single named device.
@@ -571,6 +573,11 @@ vfs_unmount(const char *devname)
 	KASSERT(kd->kd_rawname != NULL);
 	KASSERT(kd->kd_device != NULL);
 
+#if !OPT_DUMBVM
+	/* Saved exec traces hold references to files. */
+	exectrace_release(kd->kd_fs);
+#endif
+
 	result = FSOP_SYNC(kd->kd_fs);
 	if (result) {
 		goto fail;
@@ -619,6 +626,10 @@ vfs_unmountall(void)
 
 		kprintf("vfs: Unmounting %s:\n", dev->kd_name);
 
+#if !OPT_DUMBVM
+		exectrace_release(dev->kd_fs);
+#endif
+
 		result = FSOP_SYNC(dev->kd_fs);
 		if (result) {
 			kprintf("vfs: Warning: sync failed for %s: %s, trying "
@@ -51,6 +51,7 @@ vnode_init(struct vnode *vn, const struct vnode_ops *ops,
 	vn->vn_ops = ops;
 	vn->vn_refcount = 1;
 	vn->vn_opencount = 0;
+	vn->vn_wgen = 0;
 	vn->vn_fs = fs;
 	vn->vn_data = fsdata;
 	return 0;
@@ -0,0 +1,822 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <pagetable.h>
+#include <coremap.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <swap.h>
+#include <exectrace.h>
+#include <vm.h>
+
+/*
+ * Address spaces for the paged VM system.
+ *
+ * An address space is a sorted list of regions plus a page table.
+ * Defining a region doesn't allocate any memory; pages are given
+ * frames one at a time by vm_fault.
+ *
+ * as_copy doesn't copy anything either: the child gets the parent's
+ * frames (and swap slots), and writable pages are marked
+ * copy-on-write in both (see vm.c).
+ *
+ * Resident page table entries may be changed by the evictor at any
+ * time, so they are only looked at under coremap_lock.
+ *
+ * mmap adds regions of its own, placed top down starting just below
+ * the stack's growth limit, so they stay clear of both the heap and
+ * the stack. munmap and mprotect may split them.
+ */
+
+/* Highest address for mappings: below the stack limit and its guard. */
+#define AS_MMAPTOP  (USERSTACK - (VM_STACKMAXPAGES + VM_STACKGUARD) * PAGE_SIZE)
+
+struct addrspace *
+as_create(void)
+{
+	struct addrspace *as;
+
+	as = kmalloc(sizeof(struct addrspace));
+	if (as == NULL) {
+		return NULL;
+	}
+
+	as->as_pt = pt_create();
+	if (as->as_pt == NULL) {
+		kfree(as);
+		return NULL;
+	}
+	as->as_regions = NULL;
+	as->as_heap = NULL;
+	as->as_brk = 0;
+	as->as_stack = NULL;
+	as->as_loading = false;
+	as->as_asid = 0;
+	as->as_asidgen = 0;
+	as->as_cpus = 0;
+	as->as_trace = NULL;
+
+	return as;
+}
+
+/*
+ * Add a region covering [vaddr, vaddr + npages pages) to AS, keeping
+ * the list sorted, and hand it back in RET if that isn't NULL.
+ * Overlapping regions are refused. Only the heap may be empty.
+ */
+static
+int
+as_add_region(struct addrspace *as, vaddr_t vaddr, size_t npages, int perms,
+	      struct vm_region **ret)
+{
+	struct vm_region *vr, **prev;
+	vaddr_t top;
+
+	top = vaddr + npages * PAGE_SIZE;
+	if (top < vaddr || top > USERSPACETOP) {
+		return EFAULT;
+	}
+
+	for (prev = &as->as_regions; *prev != NULL; prev = &(*prev)->vr_next) {
+		if ((*prev)->vr_base >= top) {
+			break;
+		}
+		if ((*prev)->vr_base + (*prev)->vr_npages * PAGE_SIZE > vaddr) {
+			kprintf("vm: Warning: overlapping regions\n");
+			return EINVAL;
+		}
+	}
+
+	vr = kmalloc(sizeof(*vr));
+	if (vr == NULL) {
+		return ENOMEM;
+	}
+	vr->vr_base = vaddr;
+	vr->vr_npages = npages;
+	vr->vr_perms = perms;
+	vr->vr_flags = 0;
+	vr->vr_vnode = NULL;
+	vr->vr_fileoff = 0;
+	vr->vr_filebase = 0;
+	vr->vr_filesize = 0;
+	vr->vr_next = *prev;
+	*prev = vr;
+
+	if (ret != NULL) {
+		*ret = vr;
+	}
+	return 0;
+}
+
+/*
+ * Release page VA of AS: free its frame or swap slot, if it has one.
+ */
+static
+void
+as_freepage(struct addrspace *as, vaddr_t va)
+{
+	pte_t *pte;
+
+	pte = pt_lookup(as->as_pt, va, false);
+	if (pte == NULL || *pte == 0) {
+		return;
+	}
+
+	spinlock_acquire(&coremap_lock);
+	while ((*pte & PTE_VALID) != 0 && _coremap_busy(*pte & PTE_FRAME)) {
+		/* Let the eviction finish first. */
+		_coremap_wait();
+	}
+	if (*pte & PTE_VALID) {
+		_coremap_free(*pte & PTE_FRAME);
+	}
+	else {
+		KASSERT(*pte & PTE_SWAPPED);
+		swap_free(PTE_SLOT(*pte));
+	}
+	*pte = 0;
+	spinlock_release(&coremap_lock);
+}
+
+/*
+ * Unlink the region *PREV points to from AS and free it, along with
+ * its pages.
+ */
+static
+void
+as_remove_region(struct addrspace *as, struct vm_region **prev)
+{
+	struct vm_region *vr;
+	vaddr_t va, end;
+
+	vr = *prev;
+	end = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+
+	for (va = vr->vr_base; va < end; va += PAGE_SIZE) {
+		as_freepage(as, va);
+	}
+	if (vr->vr_vnode != NULL) {
+		vfs_close(vr->vr_vnode);
+	}
+	if (vr == as->as_heap) {
+		as->as_heap = NULL;
+	}
+	if (vr == as->as_stack) {
+		as->as_stack = NULL;
+	}
+	*prev = vr->vr_next;
+	kfree(vr);
+}
+
+/*
+ * Take a reference to V on behalf of a region. The region keeps the
+ * file open too, so it can still be read after the loader closes it.
+ */
+static
+void
+as_holdfile(struct vm_region *vr, struct vnode *v, off_t offset,
+	    vaddr_t vaddr, size_t filesize)
+{
+	VOP_INCREF(v);
+	VOP_INCOPEN(v);
+	vr->vr_vnode = v;
+	vr->vr_fileoff = offset;
+	vr->vr_filebase = vaddr;
+	vr->vr_filesize = filesize;
+}
+
+int
+as_attach_file(struct addrspace *as, struct vnode *v, off_t offset,
+	       vaddr_t vaddr, size_t filesize)
+{
+	struct vm_region *vr;
+
+	if (filesize == 0) {
+		return 0;
+	}
+
+	vr = as_find_region(as, vaddr);
+	if (vr == NULL || vr->vr_vnode != NULL ||
+	    vaddr + filesize < vaddr ||
+	    vaddr + filesize > vr->vr_base + vr->vr_npages * PAGE_SIZE) {
+		return ENOEXEC;
+	}
+
+	as_holdfile(vr, v, offset, vaddr, filesize);
+	return 0;
+}
+
+struct vm_region *
+as_find_region(struct addrspace *as, vaddr_t vaddr)
+{
+	struct vm_region *vr;
+
+	for (vr = as->as_regions; vr != NULL; vr = vr->vr_next) {
+		if (vaddr < vr->vr_base) {
+			return NULL;
+		}
+		if (vaddr < vr->vr_base + vr->vr_npages * PAGE_SIZE) {
+			return vr;
+		}
+	}
+	return NULL;
+}
+
+struct vm_region *
+as_grow_stack(struct addrspace *as, vaddr_t vaddr)
+{
+	struct vm_region *stack, *vr, *below;
+	vaddr_t floor;
+
+	stack = as->as_stack;
+	vaddr &= PAGE_FRAME;
+	if (stack == NULL || vaddr >= stack->vr_base ||
+	    vaddr < USERSTACK - VM_STACKMAXPAGES * PAGE_SIZE) {
+		return NULL;
+	}
+
+	/* Keep the guard gap above whatever is below the stack. */
+	below = NULL;
+	for (vr = as->as_regions; vr != stack; vr = vr->vr_next) {
+		below = vr;
+	}
+	if (below != NULL) {
+		floor = below->vr_base + (below->vr_npages + VM_STACKGUARD) *
+			PAGE_SIZE;
+		if (vaddr < floor) {
+			return NULL;
+		}
+	}
+
+	DEBUG(DB_VM, "vm: stack grows to 0x%x\n", vaddr);
+	stack->vr_npages += (stack->vr_base - vaddr) / PAGE_SIZE;
+	stack->vr_base = vaddr;
+	return stack;
+}
+
+int
+as_copy(struct addrspace *old, struct addrspace **ret)
+{
+	struct addrspace *new;
+	struct vm_region *vr, *newvr;
+	vaddr_t va;
+	vaddr_t dropped[TLBSHOOTDOWN_MAX];
+	pte_t *oldpte, *newpte;
+	unsigned nshared, ndropped;
+	bool writable;
+	int result;
+
+	new = as_create();
+	if (new==NULL) {
+		return ENOMEM;
+	}
+
+	nshared = 0;
+	ndropped = 0;
+	for (vr = old->as_regions; vr != NULL; vr = vr->vr_next) {
+		result = as_add_region(new, vr->vr_base, vr->vr_npages,
+				       vr->vr_perms, &newvr);
+		if (result) {
+			as_destroy(new);
+			return result;
+		}
+		newvr->vr_flags = vr->vr_flags;
+		if (vr->vr_vnode != NULL) {
+			as_holdfile(newvr, vr->vr_vnode, vr->vr_fileoff,
+				    vr->vr_filebase, vr->vr_filesize);
+		}
+		if (vr == old->as_heap) {
+			new->as_heap = newvr;
+			new->as_brk = old->as_brk;
+		}
+		if (vr == old->as_stack) {
+			new->as_stack = newvr;
+		}
+
+		/* As vm_fault decides whether to map a page writable. */
+		writable = (vr->vr_perms & VR_WRITE) != 0 || old->as_loading;
+
+		/* Share the pages that have been touched; skip the rest. */
+		for (va = vr->vr_base;
+		     va < vr->vr_base + vr->vr_npages * PAGE_SIZE;
+		     va += PAGE_SIZE) {
+			oldpte = pt_lookup(old->as_pt, va, false);
+			if (oldpte == NULL || *oldpte == 0) {
+				continue;
+			}
+			newpte = pt_lookup(new->as_pt, va, true);
+			if (newpte == NULL) {
+				as_destroy(new);
+				return ENOMEM;
+			}
+
+			spinlock_acquire(&coremap_lock);
+			while ((*oldpte & PTE_VALID) != 0 &&
+			       _coremap_busy(*oldpte & PTE_FRAME)) {
+				_coremap_wait();
+			}
+			if (*oldpte & PTE_VALID) {
+				/* Only these can be in a TLB writable. */
+				if (writable && (*oldpte & PTE_COW) == 0) {
+					if (ndropped < TLBSHOOTDOWN_MAX) {
+						dropped[ndropped] = va;
+					}
+					ndropped++;
+				}
+				/*
+				 * Even if the region isn't writable:
+				 * mprotect might make it so.
+				 */
+				*oldpte |= PTE_COW;
+				_coremap_share(*oldpte & PTE_FRAME);
+			}
+			else {
+				KASSERT(*oldpte & PTE_SWAPPED);
+				swap_share(PTE_SLOT(*oldpte));
+			}
+			*newpte = *oldpte;
+			spinlock_release(&coremap_lock);
+			nshared++;
+		}
+	}
+
+	/*
+	 * The parent may still have writable TLB entries for pages
+	 * that are now copy-on-write: the ones that were writable
+	 * before. Shoot those down, so it keeps its id (see
+	 * as_tlb_drop), unless there are too many to do one by one.
+	 */
+	if (ndropped > TLBSHOOTDOWN_MAX) {
+		vm_tlb_forget(old);
+	}
+	else if (ndropped > 0) {
+		vm_shootdown(old, dropped, ndropped);
+	}
+
+	vm_cow_forked(nshared);
+
+	*ret = new;
+	return 0;
+}
+
+void
+as_destroy(struct addrspace *as)
+{
+	exectrace_exit(as);
+
+	while (as->as_regions != NULL) {
+		as_remove_region(as, &as->as_regions);
+	}
+
+	pt_destroy(as->as_pt);
+	kfree(as);
+}
+
+void
+as_activate(void)
+{
+	struct addrspace *as;
+
+	as = curproc_getas();
+#ifdef UW
+        /* Kernel threads don't have an address spaces to activate */
+#endif
+	if (as == NULL) {
+		return;
+	}
+
+	vm_tlb_activate(as);
+}
+
+void
+as_deactivate(void)
+{
+	/* nothing */
+}
+
+int
+as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
+		 int readable, int writeable, int executable)
+{
+	size_t npages;
+	int perms;
+
+	/* Align the region. First, the base... */
+	sz += vaddr & ~(vaddr_t)PAGE_FRAME;
+	vaddr &= PAGE_FRAME;
+
+	/* ...and now the length. */
+	sz = (sz + PAGE_SIZE - 1) & PAGE_FRAME;
+
+	npages = sz / PAGE_SIZE;
+	if (npages == 0) {
+		return EFAULT;
+	}
+
+	perms = 0;
+	if (readable) {
+		perms |= VR_READ;
+	}
+	if (writeable) {
+		perms |= VR_WRITE;
+	}
+	if (executable) {
+		perms |= VR_EXEC;
+	}
+
+	return as_add_region(as, vaddr, npages, perms, NULL);
+}
+
+int
+as_prepare_load(struct addrspace *as)
+{
+	/*
+	 * Nothing to allocate; load_elf only attaches the file to the
+	 * regions, and pages are read in on demand. Until
+	 * as_complete_load, allow writes into read-only regions anyway
+	 * in case something does write them.
+	 */
+	as->as_loading = true;
+	return 0;
+}
+
+int
+as_complete_load(struct addrspace *as)
+{
+	struct vm_region *vr;
+	vaddr_t heapbase;
+	int result;
+
+	as->as_loading = false;
+
+	/* The heap starts, empty, after the last region loaded. */
+	if (as->as_heap == NULL) {
+		heapbase = 0;
+		for (vr = as->as_regions; vr != NULL; vr = vr->vr_next) {
+			heapbase = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+		}
+		result = as_add_region(as, heapbase, 0, VR_READ | VR_WRITE,
+				       &as->as_heap);
+		if (result) {
+			return result;
+		}
+		as->as_brk = heapbase;
+	}
+
+	/* Drop the writable translations made while loading. */
+	vm_tlb_forget(as);
+	return 0;
+}
+
+int
+as_define_stack(struct addrspace *as, vaddr_t *stackptr)
+{
+	int result;
+
+	result = as_add_region(as, USERSTACK - VM_STACKPAGES * PAGE_SIZE,
+			       VM_STACKPAGES, VR_READ | VR_WRITE,
+			       &as->as_stack);
+	if (result) {
+		return result;
+	}
+
+	*stackptr = USERSTACK;
+	return 0;
+}
+
+/*
+ * Drop AS's translations for [START, END) from every TLB. A range of
+ * up to TLBSHOOTDOWN_MAX pages is shot down page by page, so AS keeps
+ * its id; throwing the id away instead would use up ids, and every
+ * new generation of them flushes every cpu's TLB. Bigger ranges
+ * aren't worth doing a page at a time.
+ */
+static
+void
+as_tlb_drop(struct addrspace *as, vaddr_t start, vaddr_t end)
+{
+	vaddr_t vaddrs[TLBSHOOTDOWN_MAX];
+	vaddr_t va;
+	unsigned n;
+
+	KASSERT(start <= end);
+	if (end - start > TLBSHOOTDOWN_MAX * PAGE_SIZE) {
+		vm_tlb_forget(as);
+		return;
+	}
+
+	n = 0;
+	for (va = start; va < end; va += PAGE_SIZE) {
+		vaddrs[n++] = va;
+	}
+	if (n > 0) {
+		vm_shootdown(as, vaddrs, n);
+	}
+}
+
+int
+as_sbrk(struct addrspace *as, intptr_t amount, vaddr_t *oldbreak)
+{
+	struct vm_region *heap;
+	vaddr_t oldbrk, newbrk, oldend, newend, va;
+	size_t shrink;
+
+	heap = as->as_heap;
+	if (heap == NULL) {
+		return ENOMEM;
+	}
+
+	oldbrk = as->as_brk;
+	oldend = heap->vr_base + heap->vr_npages * PAGE_SIZE;
+	KASSERT(oldbrk >= heap->vr_base && oldbrk <= oldend);
+
+	if (amount < 0) {
+		shrink = (size_t)0 - (size_t)amount;
+		if (shrink > oldbrk - heap->vr_base) {
+			return EINVAL;
+		}
+		newbrk = oldbrk - shrink;
+		newend = ROUNDUP(newbrk, PAGE_SIZE);
+		/* Only whole pages past the new break are given back. */
+		if (newend < oldend) {
+			as_tlb_drop(as, newend, oldend);
+			for (va = newend; va < oldend; va += PAGE_SIZE) {
+				as_freepage(as, va);
+			}
+		}
+	}
+	else {
+		newbrk = oldbrk + amount;
+		if (newbrk < oldbrk || newbrk > USERSPACETOP) {
+			return ENOMEM;
+		}
+		newend = ROUNDUP(newbrk, PAGE_SIZE);
+		if (heap->vr_next != NULL && newend > heap->vr_next->vr_base) {
+			return ENOMEM;
+		}
+		/* Leave room for the stack to grow to its limit. */
+		if (as->as_stack != NULL &&
+		    newend + VM_STACKGUARD * PAGE_SIZE >
+		    USERSTACK - VM_STACKMAXPAGES * PAGE_SIZE) {
+			return ENOMEM;
+		}
+	}
+
+	heap->vr_npages = (newend - heap->vr_base) / PAGE_SIZE;
+	as->as_brk = newbrk;
+	*oldbreak = oldbrk;
+	return 0;
+}
+
+/*
+ * Split VR, an anonymous mapping, in two at VADDR, which must be a
+ * page boundary inside it. The part from VADDR up becomes a new region
+ * right after VR.
+ */
+static
+int
+as_split(struct vm_region *vr, vaddr_t vaddr)
+{
+	struct vm_region *upper;
+
+	KASSERT(vr->vr_vnode == NULL);
+	KASSERT((vaddr & PAGE_FRAME) == vaddr);
+	KASSERT(vaddr > vr->vr_base);
+	KASSERT(vaddr < vr->vr_base + vr->vr_npages * PAGE_SIZE);
+
+	upper = kmalloc(sizeof(*upper));
+	if (upper == NULL) {
+		return ENOMEM;
+	}
+	*upper = *vr;
+	upper->vr_base = vaddr;
+	upper->vr_npages = vr->vr_npages - (vaddr - vr->vr_base) / PAGE_SIZE;
+	vr->vr_npages -= upper->vr_npages;
+	vr->vr_next = upper;
+	return 0;
+}
+
+/*
+ * True if no region overlaps [VADDR, VADDR + NPAGES pages).
+ */
+static
+bool
+as_isfree(struct addrspace *as, vaddr_t vaddr, size_t npages)
+{
+	struct vm_region *vr;
+	vaddr_t top;
+
+	top = vaddr + npages * PAGE_SIZE;
+	for (vr = as->as_regions; vr != NULL; vr = vr->vr_next) {
+		if (vr->vr_base >= top) {
+			break;
+		}
+		if (vr->vr_base + vr->vr_npages * PAGE_SIZE > vaddr) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Find the highest free range of NPAGES pages below AS_MMAPTOP, not
+ * counting page 0. Returns 0 if there isn't one.
+ */
+static
+vaddr_t
+as_findgap(struct addrspace *as, size_t npages)
+{
+	struct vm_region *vr;
+	vaddr_t lo, hi, len, best;
+
+	len = npages * PAGE_SIZE;
+	best = 0;
+	lo = PAGE_SIZE;
+	for (vr = as->as_regions; ; vr = vr->vr_next) {
+		hi = (vr == NULL || vr->vr_base > AS_MMAPTOP) ?
+			AS_MMAPTOP : vr->vr_base;
+		if (hi > lo && hi - lo >= len) {
+			best = hi - len;
+		}
+		if (vr == NULL || vr->vr_base >= AS_MMAPTOP) {
+			break;
+		}
+		lo = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+	}
+	return best;
+}
+
+int
+as_mmap(struct addrspace *as, vaddr_t addr, size_t len, int perms,
+	bool fixed, vaddr_t *ret)
+{
+	struct vm_region *vr;
+	size_t npages;
+	int result;
+
+	if (len == 0) {
+		return EINVAL;
+	}
+	npages = DIVROUNDUP(len, PAGE_SIZE);
+	if (npages > USERSPACETOP / PAGE_SIZE) {
+		return ENOMEM;
+	}
+
+	if (fixed) {
+		if ((addr & PAGE_FRAME) != addr || addr == 0) {
+			return EINVAL;
+		}
+		if (addr + npages * PAGE_SIZE < addr ||
+		    addr + npages * PAGE_SIZE > USERSPACETOP ||
+		    !as_isfree(as, addr, npages)) {
+			return ENOMEM;
+		}
+	}
+	else if (addr == 0 || (addr & PAGE_FRAME) != addr ||
+		 addr + npages * PAGE_SIZE < addr ||
+		 addr + npages * PAGE_SIZE > AS_MMAPTOP ||
+		 !as_isfree(as, addr, npages)) {
+		addr = as_findgap(as, npages);
+		if (addr == 0) {
+			return ENOMEM;
+		}
+	}
+
+	result = as_add_region(as, addr, npages, perms, &vr);
+	if (result) {
+		return result;
+	}
+	vr->vr_flags = VR_MAPPED;
+
+	DEBUG(DB_VM, "vm: mapped %lu pages at 0x%x\n",
+	      (unsigned long)npages, addr);
+	*ret = addr;
+	return 0;
+}
+
+/*
+ * Check that [ADDR, END) only touches mapped regions (and, with
+ * WHOLE, is entirely covered by them), then split the regions at
+ * both ends so it is a run of whole regions.
+ */
+static
+int
+as_isolate(struct addrspace *as, vaddr_t addr, vaddr_t end, bool whole)
+{
+	struct vm_region *vr;
+	vaddr_t next;
+	int result;
+
+	next = addr;
+	for (vr = as->as_regions; vr != NULL; vr = vr->vr_next) {
+		if (vr->vr_base >= end) {
+			break;
+		}
+		if (vr->vr_base + vr->vr_npages * PAGE_SIZE <= addr) {
+			continue;
+		}
+		if ((vr->vr_flags & VR_MAPPED) == 0) {
+			return EINVAL;
+		}
+		if (whole && vr->vr_base > next) {
+			return ENOMEM;
+		}
+		next = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+	}
+	if (whole && next < end) {
+		return ENOMEM;
+	}
+
+	for (vr = as->as_regions; vr != NULL; vr = vr->vr_next) {
+		if (vr->vr_base >= end) {
+			break;
+		}
+		next = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+		if (vr->vr_base < addr && next > addr) {
+			result = as_split(vr, addr);
+			if (result) {
+				return result;
+			}
+			continue;
+		}
+		if (vr->vr_base < end && next > end) {
+			result = as_split(vr, end);
+			if (result) {
+				return result;
+			}
+		}
+	}
+	return 0;
+}
+
+int
+as_munmap(struct addrspace *as, vaddr_t addr, size_t len)
+{
+	struct vm_region **prev;
+	vaddr_t end;
+	int result;
+
+	if ((addr & PAGE_FRAME) != addr || len == 0) {
+		return EINVAL;
+	}
+	end = addr + ROUNDUP(len, PAGE_SIZE);
+	if (end < addr || end > USERSPACETOP) {
+		return EINVAL;
+	}
+
+	result = as_isolate(as, addr, end, false);
+	if (result) {
+		return result;
+	}
+
+	/* Before the frames are freed, so nothing can still reach them. */
+	as_tlb_drop(as, addr, end);
+
+	prev = &as->as_regions;
+	while (*prev != NULL && (*prev)->vr_base < end) {
+		if ((*prev)->vr_base >= addr) {
+			as_remove_region(as, prev);
+		}
+		else {
+			prev = &(*prev)->vr_next;
+		}
+	}
+	return 0;
+}
+
+int
+as_mprotect(struct addrspace *as, vaddr_t addr, size_t len, int perms)
+{
+	struct vm_region *vr;
+	vaddr_t end;
+	int result;
+
+	if ((addr & PAGE_FRAME) != addr) {
+		return EINVAL;
+	}
+	end = addr + ROUNDUP(len, PAGE_SIZE);
+	if (end < addr || end > USERSPACETOP) {
+		return ENOMEM;
+	}
+	if (end == addr) {
+		return 0;
+	}
+
+	result = as_isolate(as, addr, end, true);
+	if (result) {
+		return result;
+	}
+
+	for (vr = as->as_regions; vr != NULL && vr->vr_base < end;
+	     vr = vr->vr_next) {
+		if (vr->vr_base >= addr) {
+			vr->vr_perms = perms;
+		}
+	}
+
+	/* Drop translations that may allow more than is allowed now. */
+	as_tlb_drop(as, addr, end);
+	return 0;
+}
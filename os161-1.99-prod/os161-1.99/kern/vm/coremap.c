@@ -0,0 +1,482 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <coremap.h>
+#include <textcache.h>
+#include <vm.h>
+
+/*
+ * Coremap.
+ *
+ * There is one entry per physical frame that the VM system manages,
+ * i.e. everything ram_getsize reports after the coremap itself has
+ * been carved out of the bottom of it.
+ *
+ * Free frames are kept on a doubly linked list threaded through the
+ * entries by frame index. Allocating one frame takes the head of the
+ * list. Allocating several contiguous frames searches for a run of
+ * free entries and unlinks each of them, which the back links make
+ * constant time per frame. Freed frames go back on the head of the
+ * list, so recently used (cache-warm) frames are reused first.
+ *
+ * User frames can be shared by several page tables after a
+ * copy-on-write fork. Each entry counts the page table entries that
+ * refer to it, and coremap_free only frees the frame when the last
+ * one lets go.
+ *
+ * An unshared user frame also records which address space and page
+ * it holds, so it can be evicted. The clock hand sweeps the user
+ * frames looking for one that isn't referenced, clearing the
+ * reference bits as it goes (second chance). The bit is set whenever
+ * vm_fault loads the page into a TLB, so pages in use keep getting it
+ * set as TLB entries are replaced.
+ *
+ * While a frame is being written out it is marked busy, and anyone
+ * who wants it waits on cm_wchan.
+ *
+ * coremap_lock protects the coremap and, for user pages, the state
+ * of the page table entries that point to frames. Functions whose
+ * names begin with '_' expect the caller to hold it.
+ */
+
+/* Frame states */
+#define CME_FREE     0	/* on the free list */
+#define CME_KERNEL   1	/* kernel heap (alloc_kpages) */
+#define CME_USER     2	/* user page */
+
+#define CM_NONE      ((uint32_t)0xffffffff)
+
+struct cm_entry {
+	uint32_t cme_next;	/* free list: next free frame, or CM_NONE */
+	uint32_t cme_prev;	/* free list: previous free frame, or CM_NONE */
+	uint32_t cme_npages;	/* size of the block this frame starts, or 0 */
+	uint32_t cme_state;	/* CME_* */
+	uint32_t cme_refcount;	/* references to a user frame */
+	struct addrspace *cme_as;	/* owner of an unshared user frame */
+	vaddr_t cme_vaddr;		/* ...and the page it holds */
+	bool cme_busy;			/* being evicted */
+	bool cme_referenced;		/* used since the clock hand passed */
+	void *cme_kdata;		/* kernel heap's data for the frame */
+};
+
+static struct cm_entry *coremap;	/* NULL until bootstrapped */
+static unsigned cm_nframes;		/* number of entries */
+static paddr_t cm_base;			/* physical address of frame 0 */
+static uint32_t cm_freehead;		/* first free frame */
+static unsigned cm_nfree;		/* number of free frames */
+static unsigned cm_hand;		/* clock hand for eviction */
+static struct wchan *cm_wchan;		/* waiting for busy frames */
+
+struct spinlock coremap_lock = SPINLOCK_INITIALIZER;
+
+#define CM_PADDR(i)   (cm_base + (paddr_t)(i) * PAGE_SIZE)
+#define CM_INDEX(pa)  (((pa) - cm_base) / PAGE_SIZE)
+
+/*
+ * Reset the per-frame state of entry I for a new allocation.
+ */
+static
+void
+cm_clear(uint32_t i)
+{
+	coremap[i].cme_npages = 0;
+	coremap[i].cme_refcount = 0;
+	coremap[i].cme_as = NULL;
+	coremap[i].cme_vaddr = 0;
+	coremap[i].cme_busy = false;
+	coremap[i].cme_referenced = false;
+	coremap[i].cme_kdata = NULL;
+}
+
+/*
+ * Free list operations. Caller holds coremap_lock.
+ */
+static
+void
+cm_push(uint32_t i)
+{
+	coremap[i].cme_prev = CM_NONE;
+	coremap[i].cme_next = cm_freehead;
+	if (cm_freehead != CM_NONE) {
+		coremap[cm_freehead].cme_prev = i;
+	}
+	cm_freehead = i;
+}
+
+static
+void
+cm_unlink(uint32_t i)
+{
+	if (coremap[i].cme_prev != CM_NONE) {
+		coremap[coremap[i].cme_prev].cme_next = coremap[i].cme_next;
+	}
+	else {
+		KASSERT(cm_freehead == i);
+		cm_freehead = coremap[i].cme_next;
+	}
+	if (coremap[i].cme_next != CM_NONE) {
+		coremap[coremap[i].cme_next].cme_prev = coremap[i].cme_prev;
+	}
+	coremap[i].cme_next = coremap[i].cme_prev = CM_NONE;
+}
+
+void
+coremap_bootstrap(void)
+{
+	paddr_t lo, hi;
+	size_t cmsize;
+	unsigned i, total;
+
+	KASSERT(coremap == NULL);
+
+	ram_getsize(&lo, &hi);
+	KASSERT((lo & PAGE_FRAME) == lo);
+	KASSERT((hi & PAGE_FRAME) == hi);
+
+	/* The map itself goes at the bottom of what's left. */
+	total = (hi - lo) / PAGE_SIZE;
+	cmsize = ROUNDUP(total * sizeof(struct cm_entry), PAGE_SIZE);
+	KASSERT(lo + cmsize < hi);
+
+	cm_base = lo + cmsize;
+	cm_nframes = (hi - cm_base) / PAGE_SIZE;
+	cm_freehead = CM_NONE;
+	cm_nfree = cm_nframes;
+
+	coremap = (struct cm_entry *)PADDR_TO_KVADDR(lo);
+
+	/* Push in reverse so the lowest frames get handed out first. */
+	for (i = cm_nframes; i-- > 0; ) {
+		cm_clear(i);
+		coremap[i].cme_state = CME_FREE;
+		cm_push(i);
+	}
+	cm_hand = 0;
+
+	DEBUG(DB_VM, "coremap: %u frames at 0x%x, map uses %lu bytes\n",
+	      cm_nframes, cm_base, (unsigned long)cmsize);
+}
+
+/*
+ * Set up the wait channel. This can't be done in coremap_bootstrap,
+ * because wchan_create needs kmalloc, which needs the coremap.
+ */
+void
+coremap_bootstrap2(void)
+{
+	cm_wchan = wchan_create("coremap");
+	if (cm_wchan == NULL) {
+		panic("coremap: Could not create wait channel\n");
+	}
+}
+
+bool
+coremap_ready(void)
+{
+	return coremap != NULL;
+}
+
+paddr_t
+coremap_alloc(unsigned npages, bool kernel)
+{
+	uint32_t i, j, run;
+
+	KASSERT(coremap != NULL);
+	KASSERT(npages > 0);
+
+	spinlock_acquire(&coremap_lock);
+
+	if (npages > cm_nfree) {
+		spinlock_release(&coremap_lock);
+		return 0;
+	}
+
+	if (npages == 1) {
+		i = cm_freehead;
+		KASSERT(i != CM_NONE);
+		cm_unlink(i);
+	}
+	else {
+		/* First fit: find NPAGES free frames in a row. */
+		run = 0;
+		for (j=0; j<cm_nframes && run<npages; j++) {
+			run = (coremap[j].cme_state == CME_FREE) ? run+1 : 0;
+		}
+		if (run < npages) {
+			spinlock_release(&coremap_lock);
+			return 0;
+		}
+		i = j - npages;
+		for (j=i; j<i+npages; j++) {
+			cm_unlink(j);
+		}
+	}
+
+	for (j=i; j<i+npages; j++) {
+		KASSERT(coremap[j].cme_state == CME_FREE);
+		coremap[j].cme_state = kernel ? CME_KERNEL : CME_USER;
+		cm_clear(j);
+	}
+	coremap[i].cme_npages = npages;
+	coremap[i].cme_refcount = 1;
+	cm_nfree -= npages;
+
+	spinlock_release(&coremap_lock);
+
+	return CM_PADDR(i);
+}
+
+void
+coremap_free(paddr_t paddr)
+{
+	if (coremap == NULL || paddr < cm_base) {
+		/* Stolen before the coremap existed; can't give it back. */
+		return;
+	}
+
+	spinlock_acquire(&coremap_lock);
+	_coremap_free(paddr);
+	spinlock_release(&coremap_lock);
+}
+
+unsigned
+coremap_nfree(void)
+{
+	return cm_nfree;
+}
+
+unsigned
+coremap_nframes(void)
+{
+	return cm_nframes;
+}
+
+unsigned
+coremap_frameno(paddr_t paddr)
+{
+	KASSERT(paddr >= cm_base && paddr < CM_PADDR(cm_nframes));
+	return CM_INDEX(paddr);
+}
+
+paddr_t
+coremap_frameaddr(unsigned frameno)
+{
+	KASSERT(frameno < cm_nframes);
+	return CM_PADDR(frameno);
+}
+
+void
+coremap_setkdata(paddr_t paddr, void *data)
+{
+	KASSERT((paddr & PAGE_FRAME) == paddr);
+
+	if (coremap == NULL || paddr < cm_base) {
+		/* Stolen before the coremap existed. */
+		return;
+	}
+	KASSERT(paddr < CM_PADDR(cm_nframes));
+	KASSERT(coremap[CM_INDEX(paddr)].cme_state == CME_KERNEL);
+	coremap[CM_INDEX(paddr)].cme_kdata = data;
+}
+
+bool
+coremap_getkdata(paddr_t paddr, void **data)
+{
+	if (coremap == NULL || paddr < cm_base ||
+	    paddr >= CM_PADDR(cm_nframes)) {
+		return false;
+	}
+	*data = coremap[CM_INDEX(paddr)].cme_kdata;
+	return true;
+}
+
+void
+_coremap_free(paddr_t paddr)
+{
+	uint32_t i, j, npages;
+
+	KASSERT((paddr & PAGE_FRAME) == paddr);
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+	KASSERT(paddr >= cm_base && paddr < CM_PADDR(cm_nframes));
+
+	i = CM_INDEX(paddr);
+
+	npages = coremap[i].cme_npages;
+	if (npages == 0 || coremap[i].cme_state == CME_FREE) {
+		panic("coremap_free: 0x%x is not an allocated block\n", paddr);
+	}
+	KASSERT(i + npages <= cm_nframes);
+	KASSERT(coremap[i].cme_refcount > 0);
+	KASSERT(!coremap[i].cme_busy);
+
+	coremap[i].cme_refcount--;
+	if (coremap[i].cme_refcount > 0) {
+		/*
+		 * Still shared. We don't know which address space
+		 * let go, so forget the owner; the one left claims it
+		 * in _coremap_touch.
+		 */
+		coremap[i].cme_as = NULL;
+		return;
+	}
+
+	if (coremap[i].cme_state == CME_USER) {
+		_textcache_remove(paddr);
+	}
+
+	for (j=i; j<i+npages; j++) {
+		KASSERT(coremap[j].cme_state != CME_FREE);
+		coremap[j].cme_state = CME_FREE;
+		cm_clear(j);
+		cm_push(j);
+	}
+	cm_nfree += npages;
+}
+
+/*
+ * Look up the entry for user frame PADDR. Caller holds coremap_lock.
+ */
+static
+struct cm_entry *
+cm_userentry(paddr_t paddr)
+{
+	struct cm_entry *cme;
+
+	KASSERT((paddr & PAGE_FRAME) == paddr);
+	KASSERT(paddr >= cm_base && paddr < CM_PADDR(cm_nframes));
+
+	cme = &coremap[CM_INDEX(paddr)];
+	KASSERT(cme->cme_state == CME_USER);
+	KASSERT(cme->cme_npages == 1);
+	KASSERT(cme->cme_refcount > 0);
+	return cme;
+}
+
+void
+_coremap_share(paddr_t paddr)
+{
+	struct cm_entry *cme;
+
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+	cme = cm_userentry(paddr);
+	KASSERT(!cme->cme_busy);
+	cme->cme_refcount++;
+}
+
+unsigned
+_coremap_refcount(paddr_t paddr)
+{
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+	return cm_userentry(paddr)->cme_refcount;
+}
+
+bool
+_coremap_busy(paddr_t paddr)
+{
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+	return cm_userentry(paddr)->cme_busy;
+}
+
+void
+_coremap_wait(void)
+{
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+
+	/*
+	 * Take the channel lock before letting go of coremap_lock, so
+	 * the wakeup in _coremap_unbusy can't be missed.
+	 */
+	wchan_lock(cm_wchan);
+	spinlock_release(&coremap_lock);
+	wchan_sleep(cm_wchan);
+	spinlock_acquire(&coremap_lock);
+}
+
+void
+_coremap_setowner(paddr_t paddr, struct addrspace *as, vaddr_t vaddr)
+{
+	struct cm_entry *cme;
+
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+	cme = cm_userentry(paddr);
+	KASSERT(cme->cme_refcount == 1);
+	cme->cme_as = as;
+	cme->cme_vaddr = vaddr;
+	cme->cme_referenced = true;
+}
+
+void
+_coremap_touch(paddr_t paddr, struct addrspace *as, vaddr_t vaddr)
+{
+	struct cm_entry *cme;
+
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+	cme = cm_userentry(paddr);
+	KASSERT(!cme->cme_busy);
+	if (cme->cme_as == NULL && cme->cme_refcount == 1) {
+		/* The other sharers are gone; it's ours now. */
+		cme->cme_as = as;
+		cme->cme_vaddr = vaddr;
+	}
+	cme->cme_referenced = true;
+}
+
+paddr_t
+_coremap_victim(struct addrspace **as, vaddr_t *vaddr)
+{
+	struct cm_entry *cme;
+	unsigned n;
+
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+
+	/* Two sweeps: the first may only be clearing reference bits. */
+	for (n=0; n < 2*cm_nframes; n++) {
+		cme = &coremap[cm_hand];
+		cm_hand = (cm_hand + 1) % cm_nframes;
+
+		if (cme->cme_state != CME_USER || cme->cme_busy ||
+		    cme->cme_refcount != 1 || cme->cme_as == NULL) {
+			/* Not evictable. */
+			continue;
+		}
+		if (cme->cme_referenced) {
+			cme->cme_referenced = false;
+			continue;
+		}
+
+		cme->cme_busy = true;
+		*as = cme->cme_as;
+		*vaddr = cme->cme_vaddr;
+		return CM_PADDR(cme - coremap);
+	}
+	return 0;
+}
+
+void
+_coremap_unbusy(paddr_t paddr)
+{
+	struct cm_entry *cme;
+
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+	cme = cm_userentry(paddr);
+	KASSERT(cme->cme_busy);
+	cme->cme_busy = false;
+	wchan_wakeall(cm_wchan);
+}
+
+void
+_coremap_reuse(paddr_t paddr, bool kernel)
+{
+	uint32_t i;
+
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+	KASSERT(cm_userentry(paddr)->cme_busy);
+
+	i = CM_INDEX(paddr);
+	cm_clear(i);
+	coremap[i].cme_state = kernel ? CME_KERNEL : CME_USER;
+	coremap[i].cme_npages = 1;
+	coremap[i].cme_refcount = 1;
+	wchan_wakeall(cm_wchan);
+}
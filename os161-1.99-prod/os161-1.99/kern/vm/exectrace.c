@@ -0,0 +1,254 @@
+#include <types.h>
+#include <lib.h>
+#include <synch.h>
+#include <vnode.h>
+#include <addrspace.h>
+#include <exectrace.h>
+#include <vm.h>
+
+/*
+ * Exec-time working set prefetch. See exectrace.h.
+ *
+ * A trace is a list of runs of consecutive pages, in the order their
+ * first pages were first touched. A run is one word: the virtual page
+ * number in the top 20 bits and the number of pages, less one, in the
+ * bottom 12. Touching the page just after the last run extends it;
+ * touching a page that's in the trace already does nothing.
+ *
+ * An address space being recorded has its own trace in as_trace,
+ * which only its own thread uses. The saved traces are in et_files,
+ * protected by et_lock. Dropping a reference to a file may sleep, and
+ * takes the vfs big lock, so it's never done while holding et_lock.
+ */
+
+#define RUN_MK(vpn, npages)  (((uint32_t)(vpn) << 12) | ((npages) - 1))
+#define RUN_VPN(run)         ((run) >> 12)
+#define RUN_NPAGES(run)      (((run) & 0xfff) + 1)
+#define RUN_MAXPAGES         4096
+
+struct exectrace {
+	struct vnode *et_vnode;		/* program file; NULL if unused */
+	unsigned et_wgen;		/* its vn_wgen when recorded */
+	unsigned et_lastuse;		/* for replacement */
+	unsigned et_nruns;
+	uint32_t et_runs[EXECTRACE_MAXRUNS];
+};
+
+static struct lock *et_lock;
+static struct exectrace et_files[EXECTRACE_FILES];
+static unsigned et_clock;
+
+/* Statistics, also under et_lock. */
+static unsigned et_saved;		/* traces saved */
+static unsigned et_runs;		/* programs started with a trace */
+static unsigned et_pages;		/* pages prefetched for them */
+static unsigned et_stale;		/* traces dropped, file changed */
+
+void
+exectrace_bootstrap(void)
+{
+	et_lock = lock_create("exectrace");
+	if (et_lock == NULL) {
+		panic("exectrace_bootstrap: out of memory\n");
+	}
+}
+
+/*
+ * Find the saved trace for V. Call with et_lock held.
+ */
+static
+struct exectrace *
+exectrace_find(struct vnode *v)
+{
+	unsigned i;
+
+	for (i=0; i<EXECTRACE_FILES; i++) {
+		if (et_files[i].et_vnode == v) {
+			return &et_files[i];
+		}
+	}
+	return NULL;
+}
+
+void
+exectrace_exec(struct addrspace *as, struct vnode *v)
+{
+	uint32_t runs[EXECTRACE_MAXRUNS];
+	struct exectrace *et;
+	struct vnode *stale;
+	unsigned nruns, npages, i;
+
+	KASSERT(as->as_trace == NULL);
+
+	nruns = 0;
+	stale = NULL;
+	lock_acquire(et_lock);
+	et = exectrace_find(v);
+	if (et != NULL && et->et_wgen != v->vn_wgen) {
+		stale = et->et_vnode;
+		et->et_vnode = NULL;
+		et_stale++;
+	}
+	else if (et != NULL) {
+		nruns = et->et_nruns;
+		memcpy(runs, et->et_runs, nruns * sizeof(runs[0]));
+		et->et_lastuse = ++et_clock;
+	}
+	lock_release(et_lock);
+	if (stale != NULL) {
+		VOP_DECREF(stale);
+	}
+
+	npages = 0;
+	for (i=0; i<nruns; i++) {
+		npages += vm_prefetch(as, RUN_VPN(runs[i]) * PAGE_SIZE,
+				      RUN_NPAGES(runs[i]));
+	}
+	if (nruns > 0) {
+		DEBUG(DB_EXEC, "exectrace: prefetched %u pages\n", npages);
+		lock_acquire(et_lock);
+		et_runs++;
+		et_pages += npages;
+		lock_release(et_lock);
+	}
+
+	/* Now record this run. If there's no memory, just don't. */
+	et = kmalloc(sizeof(*et));
+	if (et == NULL) {
+		return;
+	}
+	VOP_INCREF(v);
+	et->et_vnode = v;
+	et->et_wgen = v->vn_wgen;
+	et->et_lastuse = 0;
+	et->et_nruns = 0;
+	as->as_trace = et;
+}
+
+void
+exectrace_note(struct addrspace *as, struct vm_region *vr, vaddr_t vaddr)
+{
+	struct exectrace *et;
+	uint32_t run, vpn;
+	unsigned i;
+
+	et = as->as_trace;
+	if (et == NULL || vr->vr_vnode != et->et_vnode) {
+		return;
+	}
+
+	vpn = vaddr / PAGE_SIZE;
+	for (i=0; i<et->et_nruns; i++) {
+		run = et->et_runs[i];
+		if (vpn >= RUN_VPN(run) &&
+		    vpn < RUN_VPN(run) + RUN_NPAGES(run)) {
+			return;
+		}
+	}
+
+	if (et->et_nruns > 0) {
+		run = et->et_runs[et->et_nruns - 1];
+		if (vpn == RUN_VPN(run) + RUN_NPAGES(run) &&
+		    RUN_NPAGES(run) < RUN_MAXPAGES) {
+			et->et_runs[et->et_nruns - 1] =
+				RUN_MK(RUN_VPN(run), RUN_NPAGES(run) + 1);
+			return;
+		}
+	}
+	if (et->et_nruns < EXECTRACE_MAXRUNS) {
+		et->et_runs[et->et_nruns++] = RUN_MK(vpn, 1);
+	}
+}
+
+void
+exectrace_exit(struct addrspace *as)
+{
+	struct exectrace *et, *slot;
+	struct vnode *drop;
+	unsigned i;
+
+	et = as->as_trace;
+	if (et == NULL) {
+		return;
+	}
+	as->as_trace = NULL;
+
+	if (et->et_nruns == 0 || et->et_vnode->vn_wgen != et->et_wgen) {
+		/* Nothing worth keeping. */
+		VOP_DECREF(et->et_vnode);
+		kfree(et);
+		return;
+	}
+
+	lock_acquire(et_lock);
+	slot = exectrace_find(et->et_vnode);
+	if (slot != NULL) {
+		/* Replace the old trace; it already holds a reference. */
+		drop = et->et_vnode;
+	}
+	else {
+		/* Take a free slot, or the least recently used one. */
+		slot = &et_files[0];
+		for (i=0; i<EXECTRACE_FILES; i++) {
+			if (et_files[i].et_vnode == NULL) {
+				slot = &et_files[i];
+				break;
+			}
+			if (et_files[i].et_lastuse < slot->et_lastuse) {
+				slot = &et_files[i];
+			}
+		}
+		drop = slot->et_vnode;
+		slot->et_vnode = et->et_vnode;
+	}
+	slot->et_wgen = et->et_wgen;
+	slot->et_lastuse = ++et_clock;
+	slot->et_nruns = et->et_nruns;
+	memcpy(slot->et_runs, et->et_runs,
+	       et->et_nruns * sizeof(et->et_runs[0]));
+	et_saved++;
+	lock_release(et_lock);
+
+	if (drop != NULL) {
+		VOP_DECREF(drop);
+	}
+	kfree(et);
+}
+
+void
+exectrace_release(struct fs *fs)
+{
+	struct vnode *drop[EXECTRACE_FILES];
+	unsigned i, n;
+
+	n = 0;
+	lock_acquire(et_lock);
+	for (i=0; i<EXECTRACE_FILES; i++) {
+		if (et_files[i].et_vnode != NULL &&
+		    et_files[i].et_vnode->vn_fs == fs) {
+			drop[n++] = et_files[i].et_vnode;
+			et_files[i].et_vnode = NULL;
+		}
+	}
+	lock_release(et_lock);
+
+	for (i=0; i<n; i++) {
+		VOP_DECREF(drop[i]);
+	}
+}
+
+void
+exectrace_printstats(void)
+{
+	unsigned i, n;
+
+	n = 0;
+	for (i=0; i<EXECTRACE_FILES; i++) {
+		if (et_files[i].et_vnode != NULL) {
+			n++;
+		}
+	}
+	kprintf("vm: exec prefetch: %u traces kept, %u saved, %u stale; "
+		"%u programs started with %u pages prefetched\n",
+		n, et_saved, et_stale, et_runs, et_pages);
+}
@@ -0,0 +1,191 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <proc.h>
+#include <faultstat.h>
+
+/*
+ * Page fault statistics. See faultstat.h.
+ */
+
+static struct faultstat cpu_faultstat[FAULTSTAT_MAXCPUS];
+
+static const char *const faultstat_names[FAULTSTAT_COUNT] = {
+	"tlb",		/* FAULTSTAT_TLB */
+	"zero",		/* FAULTSTAT_ZERO */
+	"file",		/* FAULTSTAT_FILE */
+	"swapin",	/* FAULTSTAT_SWAPIN */
+	"cow",		/* FAULTSTAT_COW */
+};
+
+/*
+ * Histogram bucket for a fault that took NSECS: floor(log2(NSECS)).
+ */
+static
+unsigned
+faultstat_bucket(uint32_t nsecs)
+{
+	unsigned b;
+
+	b = 0;
+	while (nsecs > 1) {
+		nsecs >>= 1;
+		b++;
+	}
+	KASSERT(b < FAULTSTAT_BUCKETS);
+	return b;
+}
+
+static
+void
+faultstat_add(struct faultstat *fs, unsigned what, unsigned bucket)
+{
+	unsigned i;
+
+	for (i=0; i<FAULTSTAT_COUNT; i++) {
+		if (what & (1U << i)) {
+			fs->fs_count[i]++;
+		}
+	}
+	fs->fs_latency[bucket]++;
+}
+
+void
+faultstat_record(unsigned what, uint32_t nsecs)
+{
+	unsigned bucket;
+	int spl;
+
+	bucket = faultstat_bucket(nsecs);
+
+	/* Only our own thread changes this. */
+	faultstat_add(&curproc->p_faultstat, what, bucket);
+
+	/* Don't get moved to another cpu halfway through. */
+	spl = splhigh();
+	KASSERT(curcpu->c_number < FAULTSTAT_MAXCPUS);
+	faultstat_add(&cpu_faultstat[curcpu->c_number], what, bucket);
+	splx(spl);
+}
+
+/*
+ * Add the statistics of every cpu together into FS.
+ */
+static
+void
+faultstat_total(struct faultstat *fs)
+{
+	unsigned c, i, ncpus;
+
+	bzero(fs, sizeof(*fs));
+	ncpus = cpu_count();
+	for (c=0; c<ncpus && c<FAULTSTAT_MAXCPUS; c++) {
+		for (i=0; i<FAULTSTAT_COUNT; i++) {
+			fs->fs_count[i] += cpu_faultstat[c].fs_count[i];
+		}
+		for (i=0; i<FAULTSTAT_BUCKETS; i++) {
+			fs->fs_latency[i] += cpu_faultstat[c].fs_latency[i];
+		}
+	}
+}
+
+int
+faultstat_get(int which, struct faultstat *fs)
+{
+	if (which == FAULTSTAT_SELF) {
+		*fs = curproc->p_faultstat;
+	}
+	else if (which == FAULTSTAT_ALL) {
+		faultstat_total(fs);
+	}
+	else if (which >= 0 && (unsigned)which < cpu_count() &&
+		 which < FAULTSTAT_MAXCPUS) {
+		*fs = cpu_faultstat[which];
+	}
+	else {
+		return EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * Print one line of counts, labelled NAME.
+ */
+static
+void
+faultstat_printcounts(const char *name, const struct faultstat *fs)
+{
+	unsigned i;
+
+	kprintf("%-8s", name);
+	for (i=0; i<FAULTSTAT_COUNT; i++) {
+		kprintf(" %10u", fs->fs_count[i]);
+	}
+	kprintf("\n");
+}
+
+/*
+ * Print a process's line, for proc_foreach.
+ */
+static
+void
+faultstat_printproc(struct proc *proc, void *data)
+{
+	char name[16];
+
+	(void)data;
+	snprintf(name, sizeof(name), "pid%d", (int)proc->p_pid);
+	faultstat_printcounts(name, &proc->p_faultstat);
+}
+
+void
+faultstat_print(void)
+{
+	struct faultstat total;
+	char name[16];
+	unsigned c, i, ncpus, first, last;
+
+	ncpus = cpu_count();
+	if (ncpus > FAULTSTAT_MAXCPUS) {
+		ncpus = FAULTSTAT_MAXCPUS;
+	}
+
+	kprintf("%-8s", "");
+	for (i=0; i<FAULTSTAT_COUNT; i++) {
+		kprintf(" %10s", faultstat_names[i]);
+	}
+	kprintf("\n");
+	for (c=0; c<ncpus; c++) {
+		snprintf(name, sizeof(name), "cpu%u", c);
+		faultstat_printcounts(name, &cpu_faultstat[c]);
+	}
+	faultstat_total(&total);
+	faultstat_printcounts("total", &total);
+	proc_foreach(faultstat_printproc, NULL);
+
+	/* Only print the part of the histogram that has anything in it. */
+	first = FAULTSTAT_BUCKETS;
+	last = 0;
+	for (i=0; i<FAULTSTAT_BUCKETS; i++) {
+		if (total.fs_latency[i] != 0) {
+			if (first == FAULTSTAT_BUCKETS) {
+				first = i;
+			}
+			last = i;
+		}
+	}
+	if (first == FAULTSTAT_BUCKETS) {
+		kprintf("No faults yet.\n");
+		return;
+	}
+	kprintf("Fault service time (usec):\n");
+	for (i=first; i<=last; i++) {
+		kprintf("  %8u.%03u - %8u.%03u %10u\n",
+			(1U << i) / 1000, (1U << i) % 1000,
+			((1U << i) * 2 - 1) / 1000, ((1U << i) * 2 - 1) % 1000,
+			total.fs_latency[i]);
+	}
+}
@@ -0,0 +1,241 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <kheapprof.h>
+
+/*
+ * Kernel heap profiler. See kheapprof.h.
+ *
+ * Call sites are kept in an open hash table by address; they're never
+ * removed. Live allocations are kept in a chained hash table by
+ * pointer, so kfree can find out which site to charge, and how much.
+ * Both tables are fixed size, since they can't use kmalloc. What
+ * doesn't fit isn't tracked, and is counted instead.
+ *
+ * Allocation entries are named by index plus one, so that zero (as in
+ * the BSS) means none.
+ *
+ * Everything is protected by kp_lock. Reports are collected with it
+ * held and printed after letting go.
+ */
+
+#define KP_NSITES    256	/* call sites */
+#define KP_NALLOCS   4096	/* live allocations */
+#define KP_NBUCKETS  1024	/* buckets for live allocations */
+#define KP_TOP       10		/* lines in each report */
+
+#define KP_HASH(p)   ((((p) >> 3) ^ ((p) >> 12)) % KP_NBUCKETS)
+
+struct kp_site {
+	vaddr_t ks_pc;			/* call site; 0 if unused */
+	unsigned ks_total;		/* allocations ever */
+	unsigned ks_live;		/* live allocations */
+	size_t ks_livebytes;		/* live bytes */
+	size_t ks_markbytes;		/* live bytes at the last report */
+};
+
+struct kp_alloc {
+	vaddr_t ka_ptr;
+	size_t ka_size;
+	uint16_t ka_site;		/* index into kp_sites */
+	uint16_t ka_next;		/* next in bucket or free list */
+};
+
+static struct spinlock kp_lock = SPINLOCK_INITIALIZER;
+static struct kp_site kp_sites[KP_NSITES];
+static struct kp_alloc kp_allocs[KP_NALLOCS];
+static uint16_t kp_buckets[KP_NBUCKETS];
+static uint16_t kp_freelist;		/* released entries */
+static unsigned kp_nused;		/* entries ever used */
+static unsigned kp_nsites;		/* sites in use */
+static unsigned kp_nosite;		/* allocations from untracked sites */
+static unsigned kp_untracked;		/* allocations not tracked */
+
+/*
+ * Find the entry for call site PC, adding it if need be. NULL if the
+ * table is full.
+ */
+static
+struct kp_site *
+kp_site(vaddr_t pc)
+{
+	unsigned i, n;
+
+	i = (pc >> 2) % KP_NSITES;
+	for (n=0; n<KP_NSITES; n++) {
+		if (kp_sites[i].ks_pc == pc) {
+			return &kp_sites[i];
+		}
+		if (kp_sites[i].ks_pc == 0) {
+			kp_sites[i].ks_pc = pc;
+			kp_nsites++;
+			return &kp_sites[i];
+		}
+		i = (i + 1) % KP_NSITES;
+	}
+	return NULL;
+}
+
+void
+kheapprof_alloc(void *ptr, size_t size, vaddr_t pc)
+{
+	struct kp_site *ks;
+	struct kp_alloc *ka;
+	unsigned ix, b;
+
+	spinlock_acquire(&kp_lock);
+
+	ks = kp_site(pc);
+	if (ks == NULL) {
+		kp_nosite++;
+		spinlock_release(&kp_lock);
+		return;
+	}
+	ks->ks_total++;
+
+	if (kp_freelist != 0) {
+		ix = kp_freelist;
+		kp_freelist = kp_allocs[ix-1].ka_next;
+	}
+	else if (kp_nused < KP_NALLOCS) {
+		ix = ++kp_nused;
+	}
+	else {
+		kp_untracked++;
+		spinlock_release(&kp_lock);
+		return;
+	}
+
+	ka = &kp_allocs[ix-1];
+	ka->ka_ptr = (vaddr_t)ptr;
+	ka->ka_size = size;
+	ka->ka_site = ks - kp_sites;
+	b = KP_HASH(ka->ka_ptr);
+	ka->ka_next = kp_buckets[b];
+	kp_buckets[b] = ix;
+
+	ks->ks_live++;
+	ks->ks_livebytes += size;
+
+	spinlock_release(&kp_lock);
+}
+
+void
+kheapprof_free(void *ptr)
+{
+	struct kp_site *ks;
+	struct kp_alloc *ka;
+	uint16_t *ixp, ix;
+
+	spinlock_acquire(&kp_lock);
+
+	ixp = &kp_buckets[KP_HASH((vaddr_t)ptr)];
+	for (; *ixp != 0; ixp = &ka->ka_next) {
+		ka = &kp_allocs[*ixp - 1];
+		if (ka->ka_ptr != (vaddr_t)ptr) {
+			continue;
+		}
+
+		ks = &kp_sites[ka->ka_site];
+		KASSERT(ks->ks_live > 0);
+		KASSERT(ks->ks_livebytes >= ka->ka_size);
+		ks->ks_live--;
+		ks->ks_livebytes -= ka->ka_size;
+
+		ix = *ixp;
+		*ixp = ka->ka_next;
+		ka->ka_next = kp_freelist;
+		kp_freelist = ix;
+		break;
+	}
+
+	/* Not found: allocated while the tables were full. */
+	spinlock_release(&kp_lock);
+}
+
+/*
+ * Add site I, with sort key KEY, to the list of the KP_TOP biggest in
+ * IDX/KEYS, which has *N entries so far.
+ */
+static
+void
+kp_rank(unsigned *idx, long *keys, unsigned *n, unsigned i, long key)
+{
+	unsigned j;
+
+	if (*n == KP_TOP && key <= keys[KP_TOP-1]) {
+		return;
+	}
+	if (*n < KP_TOP) {
+		(*n)++;
+	}
+	for (j = *n - 1; j > 0 && keys[j-1] < key; j--) {
+		idx[j] = idx[j-1];
+		keys[j] = keys[j-1];
+	}
+	idx[j] = i;
+	keys[j] = key;
+}
+
+void
+kheapprof_report(void)
+{
+	struct kp_site top[KP_TOP], grew[KP_TOP];
+	unsigned topidx[KP_TOP], grewidx[KP_TOP];
+	long topkeys[KP_TOP], grewkeys[KP_TOP];
+	unsigned ntop, ngrew, nsites, nosite, untracked, i;
+
+	ntop = ngrew = 0;
+
+	spinlock_acquire(&kp_lock);
+	for (i=0; i<KP_NSITES; i++) {
+		if (kp_sites[i].ks_pc == 0) {
+			continue;
+		}
+		if (kp_sites[i].ks_livebytes > 0) {
+			kp_rank(topidx, topkeys, &ntop, i,
+				kp_sites[i].ks_livebytes);
+		}
+		if (kp_sites[i].ks_livebytes > kp_sites[i].ks_markbytes) {
+			kp_rank(grewidx, grewkeys, &ngrew, i,
+				kp_sites[i].ks_livebytes -
+				kp_sites[i].ks_markbytes);
+		}
+	}
+	for (i=0; i<ntop; i++) {
+		top[i] = kp_sites[topidx[i]];
+	}
+	for (i=0; i<ngrew; i++) {
+		grew[i] = kp_sites[grewidx[i]];
+	}
+	/* This is the snapshot the next report compares against. */
+	for (i=0; i<KP_NSITES; i++) {
+		kp_sites[i].ks_markbytes = kp_sites[i].ks_livebytes;
+	}
+	nsites = kp_nsites;
+	nosite = kp_nosite;
+	untracked = kp_untracked;
+	spinlock_release(&kp_lock);
+
+	kprintf("Heap profile: %u call sites; %u allocations untracked "
+		"(%u from unknown sites)\n", nsites, nosite + untracked,
+		nosite);
+
+	kprintf("Top allocators by live bytes:\n");
+	kprintf("    call site      live    bytes   total\n");
+	for (i=0; i<ntop; i++) {
+		kprintf("    0x%08lx %8u %8lu %7u\n",
+			(unsigned long)top[i].ks_pc, top[i].ks_live,
+			(unsigned long)top[i].ks_livebytes, top[i].ks_total);
+	}
+
+	kprintf("Growth in live bytes since the last report:\n");
+	if (ngrew == 0) {
+		kprintf("    none\n");
+	}
+	for (i=0; i<ngrew; i++) {
+		kprintf("    0x%08lx +%ld bytes, now %lu in %u\n",
+			(unsigned long)grew[i].ks_pc, grewkeys[i],
+			(unsigned long)grew[i].ks_livebytes, grew[i].ks_live);
+	}
+}
@@ -29,8 +29,17 @@
 
 #include <types.h>
 #include <lib.h>
+#include <spl.h>
 #include <spinlock.h>
+#include <cpu.h>
+#include <current.h>
 #include <vm.h>
+#include <kheapprof.h>
+#include "opt-kheapprof.h"
+#include "opt-dumbvm.h"
+#if !OPT_DUMBVM
+#include <coremap.h>
+#endif
 
 /*
  * Kernel malloc.
@@ -75,6 +84,11 @@ fill_deadbeef(void *vptr, size_t len)
 //    cannot recursively use the subpage allocator. (We could probably
 //    make that work, but it would be painful.)
 //
+//    To find the page a freed block is on, the pagerefs are also kept
+//    in a hash table keyed by page address. A pointer whose page isn't
+//    in the table wasn't a subpage allocation, so kfree can tell the
+//    two kinds apart with one lookup either way.
+//
 
 #undef  SLOW	/* consistency checks */
 #undef SLOWER	/* lots of consistency checks */
@@ -83,12 +97,48 @@ fill_deadbeef(void *vptr, size_t len)
 
 #if PAGE_SIZE == 4096
 
-#define NSIZES 8
-static const size_t sizes[NSIZES] = { 16, 32, 64, 128, 256, 512, 1024, 2048 };
+/*
+ * Powers of two, with one more size halfway between each pair so no
+ * block is more than about a third wasted. That doesn't save memory
+ * for 1536, which fits only two to a page just like 2048; see
+ * kheap_printfrag for what each size costs in pages.
+ */
+#define NSIZES 15
+static const size_t sizes[NSIZES] = {
+	16, 24, 32, 48, 64, 96, 128, 192,
+	256, 384, 512, 768, 1024, 1536, 2048
+};
 
 #define SMALLEST_SUBPAGE_SIZE 16
 #define LARGEST_SUBPAGE_SIZE 2048
 
+/*
+ * Size to index into sizes[]: sizeclasses[(sz + 7) / 8]. All the sizes
+ * are multiples of 8, so this is exact. CLASS(prev, size, i) covers
+ * the requests bigger than PREV and no bigger than SIZE, which is
+ * sizes[i].
+ */
+#define CLASS(prev, size, i)  [(prev)/8 + 1 ... (size)/8] = (i)
+static const uint8_t sizeclasses[LARGEST_SUBPAGE_SIZE/8 + 1] = {
+	[0] = 0,
+	CLASS(0, 16, 0),
+	CLASS(16, 24, 1),
+	CLASS(24, 32, 2),
+	CLASS(32, 48, 3),
+	CLASS(48, 64, 4),
+	CLASS(64, 96, 5),
+	CLASS(96, 128, 6),
+	CLASS(128, 192, 7),
+	CLASS(192, 256, 8),
+	CLASS(256, 384, 9),
+	CLASS(384, 512, 10),
+	CLASS(512, 768, 11),
+	CLASS(768, 1024, 12),
+	CLASS(1024, 1536, 13),
+	CLASS(1536, 2048, 14),
+};
+#undef CLASS
+
 #elif PAGE_SIZE == 8192
 #error "No support for 8k pages (yet?)"
 #else
@@ -103,7 +153,8 @@ struct freelist {
 
 struct pageref {
 	struct pageref *next_samesize;
-	struct pageref *next_all;
+	struct pageref **pprev_samesize;
+	struct pageref *next_hash;
 	vaddr_t pageaddr_and_blocktype;
 	uint16_t freelist_offset;
 	uint16_t nfree;
@@ -118,48 +169,91 @@ struct pageref {
 ////////////////////////////////////////
 
 /*
- * This is cheesy. 
+ * The pagerefs live in pages of their own, allocated as the heap
+ * grows and kept on a list. Each of these pages has a bitmap of
+ * which of its pagerefs are in use, followed by as many pagerefs as
+ * fit. They are never given back; a heap that has grown that big once
+ * is likely to again.
  *
- * The problem is not that it's wasteful - we can only allocate whole
- * pages of pageref structures at a time anyway. The problem is that
- * we really ought to be able to have more than one of these pages.
+ * Since allocpageref runs with kmalloc_spinlock held, it can't get a
+ * new page itself. If it comes up empty, the caller drops the lock,
+ * gets a page, and hands it to addpagerefpage.
  *
- * However, for the time being, one page worth of pagerefs gives us
- * 256 pagerefs; this lets us manage 256 * 4k = 1M of kernel heap.
- * That would be twice as much memory as we get for *everything*.
- * Thus, we will cheat and not allow any mechanism for having a second
- * page of pageref structs.
- *
- * Then, since the size is fixed at one page, we'll simplify a bit
- * further by allocating the page in the kernel BSS instead of calling
- * alloc_kpages to get it.
+ * The bitmaps are searched a word at a time: full words are skipped,
+ * and the first clear bit in a word is found with a handful of masks
+ * instead of by trying each bit.
  */
 
-#define NPAGEREFS (PAGE_SIZE / sizeof(struct pageref))
-static struct pageref pagerefs[NPAGEREFS];
+#define PRP_NREFS  200
+#define PRP_WORDS  ((PRP_NREFS + 31) / 32)
+
+struct pagerefpage {
+	struct pagerefpage *prp_next;
+	unsigned prp_nfree;
+	uint32_t prp_inuse[PRP_WORDS];
+	struct pageref prp_refs[PRP_NREFS];
+};
+
+static struct pagerefpage *pagerefpages;
+static unsigned npagerefs;		/* total, for the consistency checks */
 
-#define INUSE_WORDS (NPAGEREFS/32)
-static uint32_t pagerefs_inuse[INUSE_WORDS];
+/*
+ * Index of the lowest set bit in the nonzero word W.
+ */
+static
+unsigned
+lowbit(uint32_t w)
+{
+	unsigned n;
+
+	KASSERT(w != 0);
+	n = 0;
+	if ((w & 0xffff) == 0) {
+		n += 16;
+		w >>= 16;
+	}
+	if ((w & 0xff) == 0) {
+		n += 8;
+		w >>= 8;
+	}
+	if ((w & 0xf) == 0) {
+		n += 4;
+		w >>= 4;
+	}
+	if ((w & 0x3) == 0) {
+		n += 2;
+		w >>= 2;
+	}
+	if ((w & 0x1) == 0) {
+		n += 1;
+	}
+	return n;
+}
 
 static
 struct pageref *
 allocpageref(void)
 {
-	unsigned i,j;
-	uint32_t k;
+	struct pagerefpage *prp;
+	unsigned i, j;
 
-	for (i=0; i<INUSE_WORDS; i++) {
-		if (pagerefs_inuse[i]==0xffffffff) {
-			/* full */
+	for (prp = pagerefpages; prp != NULL; prp = prp->prp_next) {
+		if (prp->prp_nfree == 0) {
 			continue;
 		}
-		for (k=1,j=0; k!=0; k<<=1,j++) {
-			if ((pagerefs_inuse[i] & k)==0) {
-				pagerefs_inuse[i] |= k;
-				return &pagerefs[i*32 + j];
+		for (i=0; i<PRP_WORDS; i++) {
+			if (prp->prp_inuse[i] == 0xffffffff) {
+				/* full */
+				continue;
 			}
+			j = lowbit(~prp->prp_inuse[i]);
+			prp->prp_inuse[i] |= (uint32_t)1 << j;
+			prp->prp_nfree--;
+			KASSERT(i*32 + j < PRP_NREFS);
+			return &prp->prp_refs[i*32 + j];
 		}
-		KASSERT(0);
+		panic("kmalloc: pageref page %p has %u free but no clear bits\n",
+		      prp, prp->prp_nfree);
 	}
 
 	/* ran out */
@@ -170,35 +264,156 @@ static
 void
 freepageref(struct pageref *p)
 {
+	struct pagerefpage *prp;
 	size_t i, j;
 	uint32_t k;
 
-	j = p-pagerefs;
-	KASSERT(j < NPAGEREFS);  /* note: j is unsigned, don't test < 0 */
+	/* Pageref pages are whole pages, so the page it's on is the one. */
+	prp = (struct pagerefpage *)((vaddr_t)p & PAGE_FRAME);
+	j = p - prp->prp_refs;
+	KASSERT(j < PRP_NREFS);  /* note: j is unsigned, don't test < 0 */
 	i = j/32;
 	k = ((uint32_t)1) << (j%32);
-	KASSERT((pagerefs_inuse[i] & k) != 0);
-	pagerefs_inuse[i] &= ~k;
+	KASSERT((prp->prp_inuse[i] & k) != 0);
+	prp->prp_inuse[i] &= ~k;
+	prp->prp_nfree++;
+}
+
+/*
+ * Add the page at PAGE, fresh from alloc_kpages, to the pageref pool.
+ * Call with kmalloc_spinlock held.
+ */
+static
+void
+addpagerefpage(vaddr_t page)
+{
+	struct pagerefpage *prp;
+	unsigned i;
+
+	COMPILE_ASSERT(sizeof(struct pagerefpage) <= PAGE_SIZE);
+	KASSERT((page & PAGE_FRAME) == page);
+
+	prp = (struct pagerefpage *)page;
+	for (i=0; i<PRP_WORDS; i++) {
+		prp->prp_inuse[i] = 0;
+	}
+	/* Mark the bits past the end in use, so they're never found. */
+	if (PRP_NREFS % 32 != 0) {
+		prp->prp_inuse[PRP_WORDS-1] = ~(uint32_t)0 << (PRP_NREFS % 32);
+	}
+	prp->prp_nfree = PRP_NREFS;
+
+	prp->prp_next = pagerefpages;
+	pagerefpages = prp;
+	npagerefs += PRP_NREFS;
 }
 
 ////////////////////////////////////////
 
 static struct pageref *sizebases[NSIZES];
-static struct pageref *allbase;
+
+/*
+ * Hash table of all the pagerefs, by page address. Kernel heap pages
+ * mostly come from a few runs of frames, which spread evenly over the
+ * buckets, so the chains stay short until the heap is several times
+ * PAGEHASH_SIZE pages.
+ */
+#define PAGEHASH_SIZE   256
+#define PAGEHASH(va)    (((va) / PAGE_SIZE) & (PAGEHASH_SIZE - 1))
+static struct pageref *pagehash[PAGEHASH_SIZE];
 
 ////////////////////////////////////////
 
 /*
- * Use one spinlock for the whole thing. Making parts of the kmalloc
- * logic per-cpu is worthwhile for scalability; however, for the time
- * being at least we won't, because it adds a lot of complexity and in
- * OS/161 performance and scalability aren't super-critical.
+ * Use one spinlock for the pages and their lists. Most allocations
+ * and frees don't touch it, though; see the magazines below, and
+ * subpage_tag.
  */
 
 static struct spinlock kmalloc_spinlock = SPINLOCK_INITIALIZER;
 
 ////////////////////////////////////////
 
+/*
+ * Per-cpu magazines.
+ *
+ * Each cpu keeps a small stack of free blocks of each size, so most
+ * kmallocs and kfrees only need interrupts off (so the thread can't
+ * be switched, and moved to another cpu, in the middle) and not
+ * kmalloc_spinlock. When a magazine runs dry, half a magazine's worth
+ * of blocks is taken from the pages in sizebases[] in one go; when it
+ * overflows, the older half goes back the same way. As far as their
+ * pages are concerned, blocks in a magazine are still allocated.
+ *
+ * Bigger blocks get smaller magazines, so a cpu doesn't sit on too
+ * many pages' worth of them.
+ *
+ * A cpu's magazines are set up by kmalloc_cpuinit when the cpu is
+ * created. Before that, and early in boot before curcpu works at
+ * all, everything goes through the shared lists.
+ */
+
+#define KMALLOC_MAXCPUS  32
+#define KMAG_SIZE        16
+
+struct kmagazine {
+	unsigned km_count;
+	void *km_objs[KMAG_SIZE];
+};
+
+/*
+ * Fragmentation statistics: for each size (and, in slot NSIZES, for
+ * whole-page allocations), the number of allocations and the bytes
+ * asked for and handed out. Each cpu keeps its own, alongside its
+ * magazines; allocations made with no magazines count in
+ * kmalloc_frag, under kmalloc_spinlock.
+ */
+struct kmalloc_fragstat {
+	uint32_t kf_count;
+	uint64_t kf_requested;
+	uint64_t kf_given;
+};
+
+struct kmalloc_cpu {
+	struct kmagazine kc_mags[NSIZES];
+	struct kmalloc_fragstat kc_frag[NSIZES + 1];
+};
+
+static struct kmalloc_fragstat kmalloc_frag[NSIZES + 1];
+
+static struct kmalloc_cpu *kmalloc_cpus[KMALLOC_MAXCPUS];
+
+static
+unsigned
+kmag_capacity(unsigned blktype)
+{
+	unsigned n;
+
+	n = PAGE_SIZE / sizes[blktype] / 4;
+	if (n < 2) {
+		return 2;
+	}
+	if (n > KMAG_SIZE) {
+		return KMAG_SIZE;
+	}
+	return n;
+}
+
+/*
+ * This cpu's magazines, or NULL. Call with interrupts off.
+ */
+static
+struct kmalloc_cpu *
+kmag_mine(void)
+{
+	unsigned n;
+
+	n = curcpu->c_number;
+	return n < KMALLOC_MAXCPUS ? kmalloc_cpus[n] : NULL;
+}
+
+////////////////////////////////////////
+
 /* SLOWER implies SLOW */
 #ifdef SLOWER
 #ifndef SLOW
@@ -260,15 +475,18 @@ checksubpages(void)
 	for (i=0; i<NSIZES; i++) {
 		for (pr = sizebases[i]; pr != NULL; pr = pr->next_samesize) {
 			checksubpage(pr);
-			KASSERT(sc < NPAGEREFS);
+			KASSERT(sc < npagerefs);
 			sc++;
 		}
 	}
 
-	for (pr = allbase; pr != NULL; pr = pr->next_all) {
-		checksubpage(pr);
-		KASSERT(ac < NPAGEREFS);
-		ac++;
+	for (i=0; i<PAGEHASH_SIZE; i++) {
+		for (pr = pagehash[i]; pr != NULL; pr = pr->next_hash) {
+			checksubpage(pr);
+			KASSERT(PAGEHASH(PR_PAGEADDR(pr)) == (unsigned)i);
+			KASSERT(ac < npagerefs);
+			ac++;
+		}
 	}
 
 	KASSERT(sc==ac);
@@ -330,25 +548,167 @@ dumpsubpage(struct pageref *pr)
 	kprintf("\n");
 }
 
+/*
+ * Print the fragmentation statistics, totalled over all cpus.
+ *
+ * Bytes handed out undercount what a size really costs when its
+ * blocks don't fill a page: 1536-byte blocks fit two to a page, just
+ * like 2048-byte ones, so each one really takes half a page. So for
+ * each size we also show the page cost, PAGE_SIZE divided by the
+ * blocks per page for each allocation, and the pages it holds now.
+ */
+static
+void
+kheap_printfrag(void)
+{
+	struct kmalloc_fragstat sum, total;
+	struct pageref *pr;
+	uint64_t cost, totalcost;
+	unsigned i, j, perpage, npages;
+
+	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+
+	bzero(&total, sizeof(total));
+	totalcost = 0;
+	kprintf("Fragmentation (bytes requested/handed out/page cost):\n");
+	for (i=0; i<=NSIZES; i++) {
+		sum = kmalloc_frag[i];
+		for (j=0; j<KMALLOC_MAXCPUS; j++) {
+			if (kmalloc_cpus[j] != NULL) {
+				sum.kf_count += kmalloc_cpus[j]->kc_frag[i].kf_count;
+				sum.kf_requested +=
+					kmalloc_cpus[j]->kc_frag[i].kf_requested;
+				sum.kf_given += kmalloc_cpus[j]->kc_frag[i].kf_given;
+			}
+		}
+		if (sum.kf_count == 0) {
+			continue;
+		}
+		if (i < NSIZES) {
+			perpage = PAGE_SIZE / sizes[i];
+			cost = (uint64_t)sum.kf_count * PAGE_SIZE / perpage;
+			npages = 0;
+			for (pr = sizebases[i]; pr != NULL;
+			     pr = pr->next_samesize) {
+				npages++;
+			}
+			kprintf("   size %-4lu", (unsigned long)sizes[i]);
+		}
+		else {
+			/* Whole pages are handed out as they cost. */
+			perpage = 1;
+			cost = sum.kf_given;
+			npages = 0;
+			kprintf("   pages    ");
+		}
+		kprintf(" %8u allocs: %llu/%llu/%llu bytes, "
+			"%u%% used, %u%% of cost",
+			sum.kf_count, sum.kf_requested, sum.kf_given, cost,
+			(unsigned)(sum.kf_requested * 100 / sum.kf_given),
+			(unsigned)(sum.kf_requested * 100 / cost));
+		if (i < NSIZES) {
+			kprintf(" (%u/page, %u pages now)", perpage, npages);
+		}
+		kprintf("\n");
+		total.kf_count += sum.kf_count;
+		total.kf_requested += sum.kf_requested;
+		total.kf_given += sum.kf_given;
+		totalcost += cost;
+	}
+	if (total.kf_given > 0) {
+		kprintf("   total     %8u allocs: %llu/%llu/%llu bytes, "
+			"%u%% used, %u%% of cost\n",
+			total.kf_count, total.kf_requested, total.kf_given,
+			totalcost,
+			(unsigned)(total.kf_requested * 100 / total.kf_given),
+			(unsigned)(total.kf_requested * 100 / totalcost));
+	}
+}
+
 void
 kheap_printstats(void)
 {
 	struct pageref *pr;
+	unsigned i, j;
 
 	/* print the whole thing with interrupts off */
 	spinlock_acquire(&kmalloc_spinlock);
 
 	kprintf("Subpage allocator status:\n");
 
-	for (pr = allbase; pr != NULL; pr = pr->next_all) {
-		dumpsubpage(pr);
+	for (i=0; i<PAGEHASH_SIZE; i++) {
+		for (pr = pagehash[i]; pr != NULL; pr = pr->next_hash) {
+			dumpsubpage(pr);
+		}
+	}
+
+	/* Counts can be stale by the time they print; that's fine. */
+	for (i=0; i<KMALLOC_MAXCPUS; i++) {
+		if (kmalloc_cpus[i] == NULL) {
+			continue;
+		}
+		kprintf("cpu%u magazines:", i);
+		for (j=0; j<NSIZES; j++) {
+			kprintf(" %lu:%u", (unsigned long)sizes[j],
+				kmalloc_cpus[i]->kc_mags[j].km_count);
+		}
+		kprintf("\n");
 	}
 
+	kheap_printfrag();
+
 	spinlock_release(&kmalloc_spinlock);
 }
 
 ////////////////////////////////////////
 
+/*
+ * Remember PR as the pageref of PAGE (NULL to forget it) in the
+ * coremap entry for its frame, so kfree can find it without
+ * kmalloc_spinlock. Nothing else touches the entry while the page
+ * is ours, and a pageref doesn't change or go away while any block
+ * on its page is allocated, which a block being freed is.
+ *
+ * Pages stolen early in boot, and all pages under dumbvm, have no
+ * coremap entry; subpage_tagged says so, and kfree falls back on the
+ * hash table for them.
+ */
+static
+void
+subpage_tag(vaddr_t page, struct pageref *pr)
+{
+#if OPT_DUMBVM
+	(void)page;
+	(void)pr;
+#else
+	coremap_setkdata(KVADDR_TO_PADDR(page), pr);
+#endif
+}
+
+/*
+ * Look up the tag for the page PTRADDR is on: set *PR to its pageref,
+ * or to NULL if it isn't one of our pages. Returns false if the page
+ * can't have a tag. Doesn't need kmalloc_spinlock.
+ */
+static
+bool
+subpage_tagged(vaddr_t ptraddr, struct pageref **pr)
+{
+#if OPT_DUMBVM
+	(void)ptraddr;
+	(void)pr;
+	return false;
+#else
+	void *data;
+
+	if (!coremap_getkdata(KVADDR_TO_PADDR(ptraddr & PAGE_FRAME), &data)) {
+		return false;
+	}
+	*pr = data;
+	return true;
+#endif
+}
+
 static
 void
 remove_lists(struct pageref *pr, int blktype)
@@ -356,19 +716,18 @@ remove_lists(struct pageref *pr, int blktype)
 	struct pageref **guy;
 
 	KASSERT(blktype>=0 && blktype<NSIZES);
+	KASSERT(*pr->pprev_samesize == pr);
 
-	for (guy = &sizebases[blktype]; *guy; guy = &(*guy)->next_samesize) {
-		checksubpage(*guy);
-		if (*guy == pr) {
-			*guy = pr->next_samesize;
-			break;
-		}
+	*pr->pprev_samesize = pr->next_samesize;
+	if (pr->next_samesize != NULL) {
+		pr->next_samesize->pprev_samesize = pr->pprev_samesize;
 	}
 
-	for (guy = &allbase; *guy; guy = &(*guy)->next_all) {
+	guy = &pagehash[PAGEHASH(PR_PAGEADDR(pr))];
+	for (; *guy; guy = &(*guy)->next_hash) {
 		checksubpage(*guy);
 		if (*guy == pr) {
-			*guy = pr->next_all;
+			*guy = pr->next_hash;
 			break;
 		}
 	}
@@ -379,19 +738,279 @@ inline
 int blocktype(size_t sz)
 {
 	unsigned i;
-	for (i=0; i<NSIZES; i++) {
-		if (sz <= sizes[i]) {
-			return i;
-		}
+
+	if (sz > LARGEST_SUBPAGE_SIZE) {
+		panic("Subpage allocator cannot handle allocation of size %lu\n", 
+		      (unsigned long)sz);
+	}
+
+	i = sizeclasses[(sz + 7) / 8];
+	KASSERT(sz <= sizes[i] && (i == 0 || sz > sizes[i-1]));
+	return i;
+}
+
+/*
+ * Take a block off the freelist of page PR, which must have one.
+ */
+static
+void *
+subpage_take(struct pageref *pr)
+{
+	vaddr_t prpage;		// PR_PAGEADDR(pr)
+	vaddr_t fla;		// free list entry address
+	struct freelist *fl;	// free list entry
+	void *retptr;		// our result
+
+	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+	KASSERT(pr->nfree > 0);
+	KASSERT(pr->freelist_offset < PAGE_SIZE);
+
+	prpage = PR_PAGEADDR(pr);
+	fla = prpage + pr->freelist_offset;
+	fl = (struct freelist *)fla;
+
+	retptr = fl;
+	fl = fl->next;
+	pr->nfree--;
+
+	if (fl != NULL) {
+		KASSERT(pr->nfree > 0);
+		fla = (vaddr_t)fl;
+		KASSERT(fla - prpage < PAGE_SIZE);
+		pr->freelist_offset = fla - prpage;
+	}
+	else {
+		KASSERT(pr->nfree == 0);
+		pr->freelist_offset = INVALID_OFFSET;
 	}
 
-	panic("Subpage allocator cannot handle allocation of size %lu\n", 
-	      (unsigned long)sz);
+	return retptr;
+}
+
+/*
+ * Put the block PTR back on the freelist of its page PR. If that
+ * makes the whole page free, take the page off the lists and return
+ * its address; the caller should free_kpages it after releasing
+ * kmalloc_spinlock. Otherwise return 0.
+ */
+static
+vaddr_t
+subpage_put(struct pageref *pr, void *ptr)
+{
+	int blktype;		// index into sizes[] that we're using
+	vaddr_t prpage;		// PR_PAGEADDR(pr)
+	struct freelist *fl;	// free list entry
+	vaddr_t offset;		// offset into page
+
+	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+
+	prpage = PR_PAGEADDR(pr);
+	blktype = PR_BLOCKTYPE(pr);
+	offset = (vaddr_t)ptr - prpage;
+	KASSERT(offset < PAGE_SIZE && offset % sizes[blktype] == 0);
+
+	/*
+	 * We probably ought to check for free twice by seeing if the block
+	 * is already on the free list. But that's expensive, so we don't.
+	 */
+
+	fl = ptr;
+	if (pr->freelist_offset == INVALID_OFFSET) {
+		fl->next = NULL;
+	} else {
+		fl->next = (struct freelist *)(prpage + pr->freelist_offset);
+	}
+	pr->freelist_offset = offset;
+	pr->nfree++;
 
-	// keep compiler happy
+	KASSERT(pr->nfree <= PAGE_SIZE / sizes[blktype]);
+	if (pr->nfree == PAGE_SIZE / sizes[blktype]) {
+		/* Whole page is free. */
+		remove_lists(pr, blktype);
+		subpage_tag(prpage, NULL);
+		freepageref(pr);
+		return prpage;
+	}
 	return 0;
 }
 
+/*
+ * Find the pageref for the page PTRADDR is on, or NULL if it isn't
+ * on any of our pages.
+ */
+static
+struct pageref *
+subpage_lookup(vaddr_t ptraddr)
+{
+	struct pageref *pr;	// pageref for page we're freeing in
+	vaddr_t prpage;		// page PTRADDR is on
+
+	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+
+	prpage = ptraddr & PAGE_FRAME;
+	for (pr = pagehash[PAGEHASH(prpage)]; pr; pr = pr->next_hash) {
+		/* check for corruption */
+		KASSERT(PR_BLOCKTYPE(pr) < NSIZES);
+		checksubpage(pr);
+
+		if (PR_PAGEADDR(pr) == prpage) {
+			return pr;
+		}
+	}
+	return NULL;
+}
+
+////////////////////////////////////////
+
+/*
+ * Get a block of type BLKTYPE from this cpu's magazine, refilling it
+ * from the pages that have free blocks if it's empty. Returns NULL if
+ * there's no magazine or nothing to fill it with; the caller then
+ * takes the slow path, which gets a fresh page if need be.
+ */
+static
+void *
+kmag_alloc(unsigned blktype)
+{
+	struct kmalloc_cpu *kc;
+	struct kmagazine *km;
+	struct pageref *pr;
+	unsigned want;
+	void *ret;
+	int spl;
+
+	if (!CURCPU_EXISTS()) {
+		return NULL;
+	}
+
+	spl = splhigh();
+	kc = kmag_mine();
+	if (kc == NULL) {
+		splx(spl);
+		return NULL;
+	}
+	km = &kc->kc_mags[blktype];
+
+	if (km->km_count == 0) {
+		want = kmag_capacity(blktype) / 2;
+		spinlock_acquire(&kmalloc_spinlock);
+		for (pr = sizebases[blktype];
+		     pr != NULL && km->km_count < want;
+		     pr = pr->next_samesize) {
+			KASSERT(PR_BLOCKTYPE(pr) == blktype);
+			checksubpage(pr);
+			while (pr->nfree > 0 && km->km_count < want) {
+				km->km_objs[km->km_count++] = subpage_take(pr);
+			}
+		}
+		checksubpages();
+		spinlock_release(&kmalloc_spinlock);
+	}
+
+	ret = NULL;
+	if (km->km_count > 0) {
+		ret = km->km_objs[--km->km_count];
+	}
+	splx(spl);
+	return ret;
+}
+
+/*
+ * Return the oldest N blocks in magazine KM to their pages.
+ */
+static
+void
+kmag_drain(struct kmagazine *km, unsigned n)
+{
+	vaddr_t freepages[KMAG_SIZE];
+	struct pageref *pr;
+	unsigned i, nfreepages;
+	vaddr_t prpage;
+
+	KASSERT(n <= km->km_count);
+
+	nfreepages = 0;
+	spinlock_acquire(&kmalloc_spinlock);
+	for (i=0; i<n; i++) {
+		pr = subpage_lookup((vaddr_t)km->km_objs[i]);
+		KASSERT(pr != NULL);
+		prpage = subpage_put(pr, km->km_objs[i]);
+		if (prpage != 0) {
+			freepages[nfreepages++] = prpage;
+		}
+	}
+	checksubpages();
+	spinlock_release(&kmalloc_spinlock);
+
+	for (i=n; i<km->km_count; i++) {
+		km->km_objs[i-n] = km->km_objs[i];
+	}
+	km->km_count -= n;
+
+	for (i=0; i<nfreepages; i++) {
+		free_kpages(freepages[i]);
+	}
+}
+
+/*
+ * Put the block PTR, of type BLKTYPE, in this cpu's magazine. Returns
+ * false if there's no magazine to put it in.
+ */
+static
+bool
+kmag_free(void *ptr, unsigned blktype)
+{
+	struct kmalloc_cpu *kc;
+	struct kmagazine *km;
+	unsigned cap;
+	int spl;
+
+	if (!CURCPU_EXISTS()) {
+		return false;
+	}
+
+	spl = splhigh();
+	kc = kmag_mine();
+	if (kc == NULL) {
+		splx(spl);
+		return false;
+	}
+	km = &kc->kc_mags[blktype];
+
+	cap = kmag_capacity(blktype);
+	if (km->km_count == cap) {
+		kmag_drain(km, cap / 2);
+	}
+	km->km_objs[km->km_count++] = ptr;
+	splx(spl);
+	return true;
+}
+
+void
+kmalloc_cpuinit(unsigned cpunum)
+{
+	struct kmalloc_cpu *kc;
+	unsigned i;
+
+	if (cpunum >= KMALLOC_MAXCPUS) {
+		/* This cpu will just use the shared lists. */
+		return;
+	}
+	KASSERT(kmalloc_cpus[cpunum] == NULL);
+
+	kc = kmalloc(sizeof(*kc));
+	if (kc == NULL) {
+		return;
+	}
+	for (i=0; i<NSIZES; i++) {
+		kc->kc_mags[i].km_count = 0;
+	}
+	bzero(kc->kc_frag, sizeof(kc->kc_frag));
+	kmalloc_cpus[cpunum] = kc;
+}
+
+////////////////////////////////////////
+
 static
 void *
 subpage_kmalloc(size_t sz)
@@ -399,6 +1018,7 @@ subpage_kmalloc(size_t sz)
 	unsigned blktype;	// index into sizes[] that we're using
 	struct pageref *pr;	// pageref for page we're allocating from
 	vaddr_t prpage;		// PR_PAGEADDR(pr)
+	vaddr_t prppage;	// new page of pagerefs, if needed
 	vaddr_t fla;		// free list entry address
 	struct freelist *volatile fl;	// free list entry
 	void *retptr;		// our result
@@ -409,6 +1029,11 @@ subpage_kmalloc(size_t sz)
 	blktype = blocktype(sz);
 	sz = sizes[blktype];
 
+	retptr = kmag_alloc(blktype);
+	if (retptr != NULL) {
+		return retptr;
+	}
+
 	spinlock_acquire(&kmalloc_spinlock);
 
 	checksubpages();
@@ -423,25 +1048,7 @@ subpage_kmalloc(size_t sz)
 
 		doalloc: /* comes here after getting a whole fresh page */
 
-			KASSERT(pr->freelist_offset < PAGE_SIZE);
-			prpage = PR_PAGEADDR(pr);
-			fla = prpage + pr->freelist_offset;
-			fl = (struct freelist *)fla;
-
-			retptr = fl;
-			fl = fl->next;
-			pr->nfree--;
-
-			if (fl != NULL) {
-				KASSERT(pr->nfree > 0);
-				fla = (vaddr_t)fl;
-				KASSERT(fla - prpage < PAGE_SIZE);
-				pr->freelist_offset = fla - prpage;
-			}
-			else {
-				KASSERT(pr->nfree == 0);
-				pr->freelist_offset = INVALID_OFFSET;
-			}
+			retptr = subpage_take(pr);
 
 			checksubpages();
 
@@ -470,11 +1077,18 @@ subpage_kmalloc(size_t sz)
 
 	pr = allocpageref();
 	if (pr==NULL) {
-		/* Couldn't allocate accounting space for the new page. */
+		/* Out of pagerefs; get another page of them. */
 		spinlock_release(&kmalloc_spinlock);
-		free_kpages(prpage);
-		kprintf("kmalloc: Subpage allocator couldn't get pageref\n"); 
-		return NULL;
+		prppage = alloc_kpages(1);
+		if (prppage==0) {
+			free_kpages(prpage);
+			kprintf("kmalloc: Subpage allocator couldn't get pageref\n"); 
+			return NULL;
+		}
+		spinlock_acquire(&kmalloc_spinlock);
+		addpagerefpage(prppage);
+		pr = allocpageref();
+		KASSERT(pr != NULL);
 	}
 
 	pr->pageaddr_and_blocktype = MKPAB(prpage, blktype);
@@ -499,10 +1113,15 @@ subpage_kmalloc(size_t sz)
 	KASSERT(pr->freelist_offset == (pr->nfree-1)*sizes[blktype]);
 
 	pr->next_samesize = sizebases[blktype];
+	pr->pprev_samesize = &sizebases[blktype];
+	if (pr->next_samesize != NULL) {
+		pr->next_samesize->pprev_samesize = &pr->next_samesize;
+	}
 	sizebases[blktype] = pr;
 
-	pr->next_all = allbase;
-	allbase = pr;
+	pr->next_hash = pagehash[PAGEHASH(prpage)];
+	pagehash[PAGEHASH(prpage)] = pr;
+	subpage_tag(prpage, pr);
 
 	/* This is kind of cheesy, but avoids duplicating the alloc code. */
 	goto doalloc;
@@ -516,38 +1135,33 @@ subpage_kfree(void *ptr)
 	vaddr_t ptraddr;	// same as ptr
 	struct pageref *pr;	// pageref for page we're freeing in
 	vaddr_t prpage;		// PR_PAGEADDR(pr)
-	vaddr_t fla;		// free list entry address
-	struct freelist *fl;	// free list entry
 	vaddr_t offset;		// offset into page
 
 	ptraddr = (vaddr_t)ptr;
 
-	spinlock_acquire(&kmalloc_spinlock);
-
-	checksubpages();
-
-	for (pr = allbase; pr; pr = pr->next_all) {
-		prpage = PR_PAGEADDR(pr);
-		blktype = PR_BLOCKTYPE(pr);
-
-		/* check for corruption */
-		KASSERT(blktype>=0 && blktype<NSIZES);
-		checksubpage(pr);
-
-		if (ptraddr >= prpage && ptraddr < prpage + PAGE_SIZE) {
-			break;
-		}
+	/*
+	 * Usually the coremap knows the page's pageref. Otherwise look
+	 * in the hash table. Either way, the page can't go away while
+	 * we aren't holding the lock, since the block we're freeing is
+	 * still allocated.
+	 */
+	if (!subpage_tagged(ptraddr, &pr)) {
+		spinlock_acquire(&kmalloc_spinlock);
+		checksubpages();
+		pr = subpage_lookup(ptraddr);
+		spinlock_release(&kmalloc_spinlock);
 	}
-
 	if (pr==NULL) {
 		/* Not on any of our pages - not a subpage allocation */
-		spinlock_release(&kmalloc_spinlock);
 		return -1;
 	}
 
+	prpage = PR_PAGEADDR(pr);
+	blktype = PR_BLOCKTYPE(pr);
 	offset = ptraddr - prpage;
 
 	/* Check for proper positioning and alignment */
+	KASSERT(blktype < NSIZES);
 	if (offset >= PAGE_SIZE || offset % sizes[blktype] != 0) {
 		panic("kfree: subpage free of invalid addr %p\n", ptr);
 	}
@@ -558,33 +1172,17 @@ subpage_kfree(void *ptr)
 	 */
 	fill_deadbeef(ptr, sizes[blktype]);
 
-	/*
-	 * We probably ought to check for free twice by seeing if the block
-	 * is already on the free list. But that's expensive, so we don't.
-	 */
-
-	fla = prpage + offset;
-	fl = (struct freelist *)fla;
-	if (pr->freelist_offset == INVALID_OFFSET) {
-		fl->next = NULL;
-	} else {
-		fl->next = (struct freelist *)(prpage + pr->freelist_offset);
+	if (kmag_free(ptr, blktype)) {
+		return 0;
 	}
-	pr->freelist_offset = offset;
-	pr->nfree++;
 
-	KASSERT(pr->nfree <= PAGE_SIZE / sizes[blktype]);
-	if (pr->nfree == PAGE_SIZE / sizes[blktype]) {
-		/* Whole page is free. */
-		remove_lists(pr, blktype);
-		freepageref(pr);
+	spinlock_acquire(&kmalloc_spinlock);
+	prpage = subpage_put(pr, ptr);
+	spinlock_release(&kmalloc_spinlock);
+	if (prpage != 0) {
 		/* Call free_kpages without kmalloc_spinlock. */
-		spinlock_release(&kmalloc_spinlock);
 		free_kpages(prpage);
 	}
-	else {
-		spinlock_release(&kmalloc_spinlock);
-	}
 
 #ifdef SLOWER /* Don't get the lock unless checksubpages does something. */
 	spinlock_acquire(&kmalloc_spinlock);
@@ -595,12 +1193,51 @@ subpage_kfree(void *ptr)
 	return 0;
 }
 
+/*
+ * Count an allocation of GIVEN bytes, for a request of REQUESTED
+ * bytes, in the fragmentation statistics for size INDEX.
+ */
+static
+void
+kmalloc_account(unsigned index, size_t requested, size_t given)
+{
+	struct kmalloc_cpu *kc;
+	struct kmalloc_fragstat *kf;
+	int spl;
+
+	KASSERT(index <= NSIZES);
+
+	if (CURCPU_EXISTS()) {
+		spl = splhigh();
+		kc = kmag_mine();
+		if (kc != NULL) {
+			kf = &kc->kc_frag[index];
+			kf->kf_count++;
+			kf->kf_requested += requested;
+			kf->kf_given += given;
+			splx(spl);
+			return;
+		}
+		splx(spl);
+	}
+
+	spinlock_acquire(&kmalloc_spinlock);
+	kf = &kmalloc_frag[index];
+	kf->kf_count++;
+	kf->kf_requested += requested;
+	kf->kf_given += given;
+	spinlock_release(&kmalloc_spinlock);
+}
+
 //
 ////////////////////////////////////////////////////////////
 
 void *
 kmalloc(size_t sz)
 {
+	void *ptr;
+	unsigned blktype;
+
 	if (sz>=LARGEST_SUBPAGE_SIZE) {
 		unsigned long npages;
 		vaddr_t address;
@@ -612,10 +1249,22 @@ kmalloc(size_t sz)
 			return NULL;
 		}
 
-		return (void *)address;
+		kmalloc_account(NSIZES, sz, npages * PAGE_SIZE);
+		ptr = (void *)address;
+	}
+	else {
+		ptr = subpage_kmalloc(sz);
+		if (ptr == NULL) {
+			return NULL;
+		}
+		blktype = blocktype(sz);
+		kmalloc_account(blktype, sz, sizes[blktype]);
 	}
 
-	return subpage_kmalloc(sz);
+#if OPT_KHEAPPROF
+	kheapprof_alloc(ptr, sz, (vaddr_t)__builtin_return_address(0));
+#endif
+	return ptr;
 }
 
 void
@@ -626,7 +1275,11 @@ kfree(void *ptr)
 	 */
 	if (ptr == NULL) {
 		return;
-	} else if (subpage_kfree(ptr)) {
+	}
+#if OPT_KHEAPPROF
+	kheapprof_free(ptr);
+#endif
+	if (subpage_kfree(ptr)) {
 		KASSERT((vaddr_t)ptr%PAGE_SIZE==0);
 		free_kpages((vaddr_t)ptr);
 	}
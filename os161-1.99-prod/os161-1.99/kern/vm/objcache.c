@@ -0,0 +1,155 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <objcache.h>
+
+/*
+ * Object caches. See objcache.h.
+ *
+ * Each cache keeps its spare objects in a stack protected by the
+ * cache's spinlock, which is never held while calling kmalloc, kfree,
+ * or the constructor or destructor. The caches are also on a list,
+ * for the statistics; they're only ever added to it.
+ */
+
+struct objcache {
+	const char *oc_name;
+	size_t oc_size;
+	int (*oc_ctor)(void *obj);
+	void (*oc_dtor)(void *obj);
+	struct objcache *oc_next;	/* list of all caches */
+
+	struct spinlock oc_lock;
+	unsigned oc_depth;		/* room for spares */
+	unsigned oc_nspare;		/* spares now */
+	void **oc_spare;		/* the spares */
+
+	/* Statistics, also under oc_lock. */
+	unsigned oc_gets;		/* objects handed out */
+	unsigned oc_reused;		/* ...that were spares */
+	unsigned oc_live;		/* handed out, not given back */
+	unsigned oc_destroyed;		/* given back with no room left */
+};
+
+static struct objcache *allcaches;
+static struct spinlock allcaches_lock = SPINLOCK_INITIALIZER;
+
+struct objcache *
+objcache_create(const char *name, size_t size, unsigned depth,
+		int (*ctor)(void *obj), void (*dtor)(void *obj))
+{
+	struct objcache *oc;
+
+	KASSERT(size > 0);
+	KASSERT(depth > 0);
+
+	oc = kmalloc(sizeof(*oc));
+	if (oc == NULL) {
+		return NULL;
+	}
+	oc->oc_spare = kmalloc(depth * sizeof(oc->oc_spare[0]));
+	if (oc->oc_spare == NULL) {
+		kfree(oc);
+		return NULL;
+	}
+	oc->oc_name = name;
+	oc->oc_size = size;
+	oc->oc_ctor = ctor;
+	oc->oc_dtor = dtor;
+	spinlock_init(&oc->oc_lock);
+	oc->oc_depth = depth;
+	oc->oc_nspare = 0;
+	oc->oc_gets = 0;
+	oc->oc_reused = 0;
+	oc->oc_live = 0;
+	oc->oc_destroyed = 0;
+
+	spinlock_acquire(&allcaches_lock);
+	oc->oc_next = allcaches;
+	allcaches = oc;
+	spinlock_release(&allcaches_lock);
+
+	return oc;
+}
+
+void *
+objcache_get(struct objcache *oc)
+{
+	return objcache_getcount(oc, NULL);
+}
+
+void *
+objcache_getcount(struct objcache *oc, unsigned *saved)
+{
+	void *obj;
+	int result;
+
+	spinlock_acquire(&oc->oc_lock);
+	if (oc->oc_nspare > 0) {
+		obj = oc->oc_spare[--oc->oc_nspare];
+		oc->oc_gets++;
+		oc->oc_reused++;
+		oc->oc_live++;
+		if (saved != NULL) {
+			(*saved)++;
+		}
+		spinlock_release(&oc->oc_lock);
+		return obj;
+	}
+	spinlock_release(&oc->oc_lock);
+
+	obj = kmalloc(oc->oc_size);
+	if (obj == NULL) {
+		return NULL;
+	}
+	if (oc->oc_ctor != NULL) {
+		result = oc->oc_ctor(obj);
+		if (result) {
+			kfree(obj);
+			return NULL;
+		}
+	}
+
+	spinlock_acquire(&oc->oc_lock);
+	oc->oc_gets++;
+	oc->oc_live++;
+	spinlock_release(&oc->oc_lock);
+	return obj;
+}
+
+void
+objcache_put(struct objcache *oc, void *obj)
+{
+	KASSERT(obj != NULL);
+
+	spinlock_acquire(&oc->oc_lock);
+	KASSERT(oc->oc_live > 0);
+	oc->oc_live--;
+	if (oc->oc_nspare < oc->oc_depth) {
+		oc->oc_spare[oc->oc_nspare++] = obj;
+		spinlock_release(&oc->oc_lock);
+		return;
+	}
+	oc->oc_destroyed++;
+	spinlock_release(&oc->oc_lock);
+
+	if (oc->oc_dtor != NULL) {
+		oc->oc_dtor(obj);
+	}
+	kfree(obj);
+}
+
+void
+objcache_printstats(void)
+{
+	struct objcache *oc;
+
+	kprintf("Object caches:\n");
+	for (oc = allcaches; oc != NULL; oc = oc->oc_next) {
+		kprintf("  %-10s %4lu bytes: %u live, %u/%u spare; "
+			"%u gets, %u reused, %u destroyed\n",
+			oc->oc_name, (unsigned long)oc->oc_size,
+			oc->oc_live, oc->oc_nspare, oc->oc_depth,
+			oc->oc_gets, oc->oc_reused, oc->oc_destroyed);
+	}
+}
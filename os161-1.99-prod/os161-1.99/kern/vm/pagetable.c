@@ -0,0 +1,59 @@
+#include <types.h>
+#include <lib.h>
+#include <pagetable.h>
+
+/*
+ * Two-level page table for user address spaces. See pagetable.h.
+ */
+
+struct pagetable *
+pt_create(void)
+{
+	struct pagetable *pt;
+	unsigned i;
+
+	pt = kmalloc(sizeof(*pt));
+	if (pt == NULL) {
+		return NULL;
+	}
+	for (i=0; i<PT_NENTRIES; i++) {
+		pt->pt_dir[i] = NULL;
+	}
+	return pt;
+}
+
+void
+pt_destroy(struct pagetable *pt)
+{
+	unsigned i;
+
+	for (i=0; i<PT_NENTRIES; i++) {
+		if (pt->pt_dir[i] != NULL) {
+			kfree(pt->pt_dir[i]);
+		}
+	}
+	kfree(pt);
+}
+
+pte_t *
+pt_lookup(struct pagetable *pt, vaddr_t vaddr, bool create)
+{
+	pte_t *table;
+	unsigned i;
+
+	table = pt->pt_dir[PT_DIRINDEX(vaddr)];
+	if (table == NULL) {
+		if (!create) {
+			return NULL;
+		}
+		table = kmalloc(PT_NENTRIES * sizeof(pte_t));
+		if (table == NULL) {
+			return NULL;
+		}
+		for (i=0; i<PT_NENTRIES; i++) {
+			table[i] = 0;
+		}
+		pt->pt_dir[PT_DIRINDEX(vaddr)] = table;
+	}
+	return &table[PT_TBLINDEX(vaddr)];
+}
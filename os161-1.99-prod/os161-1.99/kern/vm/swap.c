@@ -0,0 +1,271 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <uw-vmstats.h>
+#include <swap.h>
+#include <zswap.h>
+#include <vm.h>
+
+/*
+ * Swap space.
+ *
+ * Each slot has a reference count, so a swapped-out page can be
+ * shared copy-on-write like a resident one. A slot is free when its
+ * count is zero. Allocation scans from just after the last slot
+ * handed out.
+ *
+ * The counts are protected by swap_lock. The device itself can be
+ * read and written by several threads at once; the disk driver
+ * serializes the requests.
+ *
+ * Pages go through the compressed swap cache (zswap.c) on the way:
+ * swap_out only writes a page to the disk if zswap can't keep it, and
+ * swap_in only reads it from there if zswap doesn't have it. Only
+ * transfers that reach the disk, write-backs included, count as swap
+ * I/O in the vmstats; a fault zswap satisfies is counted on its own.
+ *
+ * When zswap is full, swap_out first writes zswap's oldest pages to
+ * their own slots to make room (swap_writeback), decompressing them
+ * into swap_wbframe, which swap_wblock protects.
+ */
+
+#define SWAP_MAXREF  0xffff
+
+static struct vnode *swap_vnode;	/* NULL if there is no swap */
+static unsigned swap_nslots;
+static uint16_t *swap_refs;		/* reference count per slot */
+static unsigned swap_next;		/* where to start looking */
+static unsigned swap_nfree;
+
+static struct spinlock swap_lock = SPINLOCK_INITIALIZER;
+
+static struct lock *swap_wblock;
+static paddr_t swap_wbframe;
+
+void
+swap_bootstrap(void)
+{
+	char path[sizeof(SWAP_DEVICE)];
+	struct stat st;
+	vaddr_t wbpage;
+	unsigned i;
+	int result;
+
+	/* vfs_open destroys the path it is given. */
+	strcpy(path, SWAP_DEVICE);
+	result = vfs_open(path, O_RDWR, 0, &swap_vnode);
+	if (result) {
+		kprintf("swap: %s: %s; running without swap\n", SWAP_DEVICE,
+			strerror(result));
+		swap_vnode = NULL;
+		return;
+	}
+
+	result = VOP_STAT(swap_vnode, &st);
+	if (result || st.st_size < PAGE_SIZE) {
+		kprintf("swap: %s: cannot get size; running without swap\n",
+			SWAP_DEVICE);
+		vfs_close(swap_vnode);
+		swap_vnode = NULL;
+		return;
+	}
+
+	swap_nslots = st.st_size / PAGE_SIZE;
+	swap_refs = kmalloc(swap_nslots * sizeof(swap_refs[0]));
+	if (swap_refs == NULL) {
+		kprintf("swap: out of memory; running without swap\n");
+		vfs_close(swap_vnode);
+		swap_vnode = NULL;
+		return;
+	}
+	for (i=0; i<swap_nslots; i++) {
+		swap_refs[i] = 0;
+	}
+	swap_next = 0;
+	swap_nfree = swap_nslots;
+
+	kprintf("swap: %s, %u pages\n", SWAP_DEVICE, swap_nslots);
+
+	/* Without somewhere to write back to, zswap is no use when full. */
+	swap_wblock = lock_create("swap writeback");
+	wbpage = alloc_kpages(1);
+	if (swap_wblock == NULL || wbpage == 0) {
+		kprintf("swap: out of memory; no compressed swap cache\n");
+		return;
+	}
+	swap_wbframe = KVADDR_TO_PADDR(wbpage);
+
+	zswap_bootstrap(swap_nslots);
+}
+
+int
+swap_alloc(unsigned *slot)
+{
+	unsigned i;
+
+	spinlock_acquire(&swap_lock);
+
+	if (swap_nfree == 0) {
+		spinlock_release(&swap_lock);
+		return ENOSPC;
+	}
+
+	i = swap_next;
+	while (swap_refs[i] != 0) {
+		i = (i + 1) % swap_nslots;
+	}
+	swap_refs[i] = 1;
+	swap_nfree--;
+	swap_next = (i + 1) % swap_nslots;
+
+	spinlock_release(&swap_lock);
+
+	*slot = i;
+	return 0;
+}
+
+void
+swap_share(unsigned slot)
+{
+	KASSERT(slot < swap_nslots);
+
+	spinlock_acquire(&swap_lock);
+	KASSERT(swap_refs[slot] > 0);
+	if (swap_refs[slot] == SWAP_MAXREF) {
+		panic("swap: too many references to slot %u\n", slot);
+	}
+	swap_refs[slot]++;
+	spinlock_release(&swap_lock);
+}
+
+void
+swap_free(unsigned slot)
+{
+	KASSERT(slot < swap_nslots);
+
+	spinlock_acquire(&swap_lock);
+	KASSERT(swap_refs[slot] > 0);
+	swap_refs[slot]--;
+	if (swap_refs[slot] == 0) {
+		/* Before anyone can allocate it again. */
+		zswap_drop(slot);
+		swap_nfree++;
+	}
+	spinlock_release(&swap_lock);
+}
+
+/*
+ * Transfer one page between the frame at PADDR and SLOT.
+ */
+static
+int
+swap_io(unsigned slot, paddr_t paddr, enum uio_rw rw)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	KASSERT(swap_vnode != NULL);
+	KASSERT(slot < swap_nslots);
+
+	uio_kinit(&iov, &ku, (void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE,
+		  (off_t)slot * PAGE_SIZE, rw);
+	if (rw == UIO_READ) {
+		result = VOP_READ(swap_vnode, &ku);
+	}
+	else {
+		result = VOP_WRITE(swap_vnode, &ku);
+	}
+	if (result) {
+		return result;
+	}
+	if (ku.uio_resid != 0) {
+		kprintf("swap: short transfer on slot %u\n", slot);
+		return EIO;
+	}
+	return 0;
+}
+
+/*
+ * Write zswap's oldest page out to its own slot, so it no longer has
+ * to be kept. Returns false if there's nothing to write back, or the
+ * write failed.
+ */
+static
+bool
+swap_writeback(void)
+{
+	unsigned slot;
+	bool found;
+	int result;
+
+	/* Hold a reference so the slot can't be freed and reused. */
+	spinlock_acquire(&swap_lock);
+	if (!zswap_oldest(&slot)) {
+		spinlock_release(&swap_lock);
+		return false;
+	}
+	KASSERT(swap_refs[slot] > 0 && swap_refs[slot] < SWAP_MAXREF);
+	swap_refs[slot]++;
+	spinlock_release(&swap_lock);
+
+	lock_acquire(swap_wblock);
+	/* Nobody else can drop it while we hold the reference. */
+	found = zswap_writeback(slot, swap_wbframe);
+	KASSERT(found);
+	result = swap_io(slot, swap_wbframe, UIO_WRITE);
+	lock_release(swap_wblock);
+	if (result == 0) {
+		vmstats_inc(VMSTAT_SWAP_FILE_WRITE);
+	}
+
+	zswap_written(slot, result == 0);
+	swap_free(slot);
+	return result == 0;
+}
+
+int
+swap_in(unsigned slot, paddr_t paddr)
+{
+	int result;
+
+	if (!zswap_load(slot, paddr)) {
+		result = swap_io(slot, paddr, UIO_READ);
+		if (result) {
+			return result;
+		}
+		vmstats_inc(VMSTAT_SWAP_FILE_READ);
+		vmstats_inc(VMSTAT_PAGE_FAULT_DISK);
+	}
+	else {
+		vmstats_inc(VMSTAT_PAGE_FAULT_ZSWAP);
+	}
+	return 0;
+}
+
+int
+swap_out(unsigned slot, paddr_t paddr)
+{
+	int result;
+
+	while ((result = zswap_store(slot, paddr)) == ENOSPC) {
+		if (!swap_writeback()) {
+			break;
+		}
+	}
+	if (result) {
+		result = swap_io(slot, paddr, UIO_WRITE);
+		if (result) {
+			return result;
+		}
+		vmstats_inc(VMSTAT_SWAP_FILE_WRITE);
+	}
+	return 0;
+}
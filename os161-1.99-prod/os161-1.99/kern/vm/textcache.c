@@ -0,0 +1,185 @@
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <addrspace.h>
+#include <coremap.h>
+#include <textcache.h>
+#include <vm.h>
+
+/*
+ * Text page cache.
+ *
+ * There is one slot per frame, in a table parallel to the coremap, so
+ * nothing has to be allocated with coremap_lock held. A slot whose
+ * tp_vnode is NULL isn't in use. Slots in use are chained by frame
+ * number into hash buckets.
+ *
+ * Two pages are the same if they're at the same address in regions
+ * made from the same part of the same file. Regions only hold the
+ * vnode (by reference) while they exist, and cached frames are always
+ * mapped by some region, so a vnode in the table is never stale.
+ */
+
+#define TC_NBUCKETS  64
+#define TC_NONE      ((uint32_t)0xffffffff)
+
+struct tc_page {
+	struct vnode *tp_vnode;		/* file, or NULL if slot is free */
+	off_t tp_fileoff;		/* region's file offset... */
+	vaddr_t tp_filebase;		/* ...address... */
+	size_t tp_filesize;		/* ...and size */
+	vaddr_t tp_vaddr;		/* page */
+	uint32_t tp_next;		/* next frame in bucket */
+};
+
+static struct tc_page *tc_pages;	/* one per frame */
+static uint32_t tc_buckets[TC_NBUCKETS];
+
+/* Statistics, also protected by coremap_lock. */
+static unsigned tc_hits;		/* pages found in the cache */
+static unsigned tc_misses;		/* pages that had to be read */
+static unsigned tc_cached;		/* frames in the cache now */
+static unsigned tc_maxcached;		/* ...at most */
+
+static
+unsigned
+tc_hash(struct vnode *v, vaddr_t vaddr)
+{
+	return (((uintptr_t)v >> 4) ^ (vaddr >> 12)) % TC_NBUCKETS;
+}
+
+static
+bool
+tc_match(struct tc_page *tp, struct vm_region *vr, vaddr_t vaddr)
+{
+	return tp->tp_vnode == vr->vr_vnode && tp->tp_vaddr == vaddr &&
+		tp->tp_fileoff == vr->vr_fileoff &&
+		tp->tp_filebase == vr->vr_filebase &&
+		tp->tp_filesize == vr->vr_filesize;
+}
+
+void
+textcache_bootstrap(void)
+{
+	unsigned i, n;
+
+	n = coremap_nframes();
+	tc_pages = kmalloc(n * sizeof(struct tc_page));
+	if (tc_pages == NULL) {
+		panic("textcache: Out of memory\n");
+	}
+	for (i=0; i<n; i++) {
+		tc_pages[i].tp_vnode = NULL;
+		tc_pages[i].tp_next = TC_NONE;
+	}
+	for (i=0; i<TC_NBUCKETS; i++) {
+		tc_buckets[i] = TC_NONE;
+	}
+}
+
+bool
+textcache_eligible(struct vm_region *vr)
+{
+	/* Program text and other read-only parts of executables. */
+	return vr->vr_vnode != NULL && (vr->vr_perms & VR_WRITE) == 0;
+}
+
+paddr_t
+_textcache_lookup(struct vm_region *vr, vaddr_t vaddr)
+{
+	uint32_t i;
+	paddr_t paddr;
+
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+	KASSERT(textcache_eligible(vr));
+
+	for (i = tc_buckets[tc_hash(vr->vr_vnode, vaddr)]; i != TC_NONE;
+	     i = tc_pages[i].tp_next) {
+		if (!tc_match(&tc_pages[i], vr, vaddr)) {
+			continue;
+		}
+		paddr = coremap_frameaddr(i);
+		if (_coremap_busy(paddr)) {
+			/* On its way out. */
+			break;
+		}
+		_coremap_share(paddr);
+		tc_hits++;
+		return paddr;
+	}
+	tc_misses++;
+	return 0;
+}
+
+bool
+_textcache_insert(struct vm_region *vr, vaddr_t vaddr, paddr_t paddr)
+{
+	struct tc_page *tp;
+	unsigned h;
+	uint32_t i;
+
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+	KASSERT(textcache_eligible(vr));
+
+	h = tc_hash(vr->vr_vnode, vaddr);
+	for (i = tc_buckets[h]; i != TC_NONE; i = tc_pages[i].tp_next) {
+		if (tc_match(&tc_pages[i], vr, vaddr)) {
+			/* Someone else read it in at the same time. */
+			return false;
+		}
+	}
+
+	i = coremap_frameno(paddr);
+	tp = &tc_pages[i];
+	KASSERT(tp->tp_vnode == NULL);
+	tp->tp_vnode = vr->vr_vnode;
+	tp->tp_fileoff = vr->vr_fileoff;
+	tp->tp_filebase = vr->vr_filebase;
+	tp->tp_filesize = vr->vr_filesize;
+	tp->tp_vaddr = vaddr;
+	tp->tp_next = tc_buckets[h];
+	tc_buckets[h] = i;
+
+	tc_cached++;
+	if (tc_cached > tc_maxcached) {
+		tc_maxcached = tc_cached;
+	}
+	return true;
+}
+
+bool
+_textcache_remove(paddr_t paddr)
+{
+	struct tc_page *tp;
+	uint32_t i, *prev;
+
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+
+	if (tc_pages == NULL) {
+		return false;
+	}
+	i = coremap_frameno(paddr);
+	tp = &tc_pages[i];
+	if (tp->tp_vnode == NULL) {
+		return false;
+	}
+
+	prev = &tc_buckets[tc_hash(tp->tp_vnode, tp->tp_vaddr)];
+	while (*prev != i) {
+		KASSERT(*prev != TC_NONE);
+		prev = &tc_pages[*prev].tp_next;
+	}
+	*prev = tp->tp_next;
+	tp->tp_next = TC_NONE;
+	tp->tp_vnode = NULL;
+
+	tc_cached--;
+	return true;
+}
+
+void
+textcache_printstats(void)
+{
+	kprintf("vm: text cache: %u hits, %u misses, %u pages cached "
+		"(at most %u)\n", tc_hits, tc_misses, tc_cached, tc_maxcached);
+}
@@ -0,0 +1,1097 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <cpu.h>
+#include <thread.h>
+#include <proc.h>
+#include <current.h>
+#include <addrspace.h>
+#include <pagetable.h>
+#include <coremap.h>
+#include <swap.h>
+#include <zswap.h>
+#include <exectrace.h>
+#include <textcache.h>
+#include <faultstat.h>
+#include <clock.h>
+#include <uw-vmstats.h>
+#include <vnode.h>
+#include <vm.h>
+
+/*
+ * Paged VM system.
+ *
+ * Each address space has a list of regions and a two-level page
+ * table. Nothing is given physical memory until it is touched;
+ * vm_fault then finds the region, allocates a frame for the page if
+ * it doesn't have one yet, fills it from the executable or with
+ * zeros, and loads the translation into the TLB.
+ *
+ * as_copy shares the parent's frames with the child instead of
+ * copying them, marking the writable ones PTE_COW in both page
+ * tables. Such pages are only ever loaded into the TLB read-only; the
+ * first write to one faults, and vm_fault gives the writer its own
+ * copy (or, if nobody else uses the frame any more, just takes it).
+ *
+ * When memory runs out, vm_evict has the coremap pick a victim with
+ * its clock hand, shoots down any TLB entries for it, writes it to
+ * swap, and hands the frame to whoever needed it. The page table
+ * entry then holds the swap slot, and the next fault on the page
+ * reads it back. Only the owning process changes its entries from
+ * not-resident to resident, so the page-in itself runs unlocked;
+ * everything else about resident pages happens under coremap_lock.
+ */
+
+/*
+ * Wrap ram_stealmem in a spinlock. This is only used until the
+ * coremap takes over in vm_bootstrap.
+ */
+static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Copy-on-write statistics, protected by cow_lock.
+ */
+static struct spinlock cow_lock = SPINLOCK_INITIALIZER;
+static unsigned cow_forks;	/* address spaces copied */
+static unsigned cow_shared;	/* pages shared rather than copied */
+static unsigned cow_copied;	/* shared pages copied on a later write */
+static unsigned cow_reclaimed;	/* written when no longer shared */
+
+/*
+ * TLB shootdowns are done one at a time, under shootdown_lock, so
+ * each cpu sent one handles it in a single call and signals
+ * shootdown_sem once. Only the cpus that have run the address space
+ * in its current address space id are sent one. The statistics are
+ * protected by shootdown_statlock.
+ */
+static struct lock *shootdown_lock;
+static struct semaphore *shootdown_sem;
+static struct spinlock shootdown_statlock = SPINLOCK_INITIALIZER;
+static unsigned shootdown_count;	/* calls to vm_shootdown */
+static unsigned shootdown_local;	/* ...that needed no IPIs */
+static unsigned shootdown_ipis;		/* IPIs sent */
+static unsigned shootdown_entries;	/* mappings sent, over all IPIs */
+static unsigned shootdown_flushes;	/* IPIs sent as TLBSHOOTDOWN_ALL */
+
+/*
+ * Pool of zeroed user frames. Idle cpus fill it (vm_idle) up to
+ * VM_ZEROPOOL frames, as long as more than VM_ZEROPOOL_RESERVE frames
+ * would be left free, and zero-fill faults take from it first. When
+ * memory runs out it is given back before anything is evicted.
+ * Everything here is protected by zero_lock.
+ */
+#define VM_ZEROPOOL          32
+#define VM_ZEROPOOL_RESERVE  64
+
+static struct spinlock zero_lock = SPINLOCK_INITIALIZER;
+static paddr_t zero_pool[VM_ZEROPOOL];
+static unsigned zero_count;	/* frames in zero_pool */
+static unsigned zero_hits;	/* zero-fill faults served from the pool */
+static unsigned zero_misses;	/* ...that had to zero a frame themselves */
+static unsigned zero_filled;	/* frames zeroed by idle cpus */
+static unsigned zero_drained;	/* frames given back under memory pressure */
+
+/*
+ * Fault-around window (see vm.h), and read-ahead statistics,
+ * protected by fa_lock.
+ */
+static unsigned fa_window = 4;
+static struct spinlock fa_lock = SPINLOCK_INITIALIZER;
+static unsigned fa_reads;	/* file reads that read ahead */
+static unsigned fa_pages;	/* pages read ahead by them */
+
+static paddr_t vm_evict(bool kernel);
+
+void
+vm_bootstrap(void)
+{
+	coremap_bootstrap();
+	coremap_bootstrap2();
+	textcache_bootstrap();
+	exectrace_bootstrap();
+	vmstats_init();
+
+	shootdown_lock = lock_create("tlbshootdown");
+	shootdown_sem = sem_create("tlbshootdown", 0);
+	if (shootdown_lock == NULL || shootdown_sem == NULL) {
+		panic("vm_bootstrap: out of memory\n");
+	}
+
+	swap_bootstrap();
+}
+
+/*
+ * Give every frame in the zero pool back to the coremap. Returns true
+ * if there were any.
+ */
+static
+bool
+vm_zeropool_drain(void)
+{
+	paddr_t pa;
+	unsigned n;
+
+	n = 0;
+	spinlock_acquire(&zero_lock);
+	while (zero_count > 0) {
+		pa = zero_pool[--zero_count];
+		/* coremap_lock nests inside zero_lock. */
+		coremap_free(pa);
+		n++;
+	}
+	zero_drained += n;
+	spinlock_release(&zero_lock);
+	return n > 0;
+}
+
+static
+paddr_t
+getppages(unsigned long npages)
+{
+	paddr_t addr;
+
+	if (coremap_ready()) {
+		addr = coremap_alloc(npages, true);
+		if (addr == 0 && (vm_zeropool_drain() || zswap_shrink())) {
+			addr = coremap_alloc(npages, true);
+		}
+		/*
+		 * Evicting means sleeping, so only try it for callers
+		 * that could sleep anyway.
+		 */
+		if (addr == 0 && npages == 1 &&
+		    !curthread->t_in_interrupt &&
+		    curthread->t_iplhigh_count == 0) {
+			addr = vm_evict(true);
+		}
+		return addr;
+	}
+
+	spinlock_acquire(&stealmem_lock);
+
+	addr = ram_stealmem(npages);
+
+	spinlock_release(&stealmem_lock);
+	return addr;
+}
+
+/* Allocate/free some kernel-space virtual pages */
+vaddr_t
+alloc_kpages(int npages)
+{
+	paddr_t pa;
+	pa = getppages(npages);
+	if (pa==0) {
+		return 0;
+	}
+	return PADDR_TO_KVADDR(pa);
+}
+
+void
+free_kpages(vaddr_t addr)
+{
+	coremap_free(KVADDR_TO_PADDR(addr));
+}
+
+/* Allocate/free one frame for a user page. Its contents are garbage. */
+paddr_t
+alloc_upage(void)
+{
+	paddr_t pa;
+
+	pa = coremap_alloc(1, false);
+	if (pa == 0 && (vm_zeropool_drain() || zswap_shrink())) {
+		pa = coremap_alloc(1, false);
+	}
+	if (pa == 0) {
+		pa = vm_evict(false);
+	}
+	return pa;
+}
+
+/*
+ * Allocate a zeroed frame for a user page, from the pool if possible.
+ */
+static
+paddr_t
+vm_zeropage(void)
+{
+	paddr_t pa;
+
+	pa = 0;
+	spinlock_acquire(&zero_lock);
+	if (zero_count > 0) {
+		pa = zero_pool[--zero_count];
+		zero_hits++;
+	}
+	else {
+		zero_misses++;
+	}
+	spinlock_release(&zero_lock);
+
+	if (pa == 0) {
+		pa = alloc_upage();
+		if (pa == 0) {
+			return 0;
+		}
+		bzero((void *)PADDR_TO_KVADDR(pa), PAGE_SIZE);
+	}
+	return pa;
+}
+
+bool
+vm_idle(void)
+{
+	paddr_t pa;
+
+	if (!coremap_ready() || zero_count >= VM_ZEROPOOL ||
+	    coremap_nfree() <= VM_ZEROPOOL_RESERVE) {
+		return false;
+	}
+
+	pa = coremap_alloc(1, false);
+	if (pa == 0) {
+		return false;
+	}
+	bzero((void *)PADDR_TO_KVADDR(pa), PAGE_SIZE);
+
+	spinlock_acquire(&zero_lock);
+	if (zero_count < VM_ZEROPOOL) {
+		zero_pool[zero_count++] = pa;
+		zero_filled++;
+		pa = 0;
+	}
+	spinlock_release(&zero_lock);
+
+	if (pa != 0) {
+		/* Another cpu got there first. */
+		coremap_free(pa);
+	}
+	return true;
+}
+
+void
+free_upage(paddr_t paddr)
+{
+	coremap_free(paddr);
+}
+
+/*
+ * Called by as_copy: NPAGES pages were shared with the new address
+ * space instead of being copied.
+ */
+void
+vm_cow_forked(unsigned npages)
+{
+	spinlock_acquire(&cow_lock);
+	cow_forks++;
+	cow_shared += npages;
+	spinlock_release(&cow_lock);
+
+	DEBUG(DB_VM, "vm: fork shared %u pages\n", npages);
+}
+
+void
+vm_printstats(void)
+{
+	unsigned avoided;
+
+	/* Pages shared at fork time, less those copied later anyway. */
+	avoided = cow_shared - cow_copied;
+
+	kprintf("vm: copy-on-write: %u forks, %u pages shared, "
+		"%u copied on write, %u reclaimed\n",
+		cow_forks, cow_shared, cow_copied, cow_reclaimed);
+	kprintf("vm: copy-on-write: %u page copies avoided (%u per fork)\n",
+		avoided, cow_forks == 0 ? 0 : avoided / cow_forks);
+	kprintf("vm: shootdowns: %u requests (%u local only), %u IPIs "
+		"carrying %u entries, %u IPIs flushing everything\n",
+		shootdown_count, shootdown_local, shootdown_ipis,
+		shootdown_entries, shootdown_flushes);
+	kprintf("vm: zero pool: %u hits, %u misses, %u zeroed while idle, "
+		"%u given back, %u in pool\n",
+		zero_hits, zero_misses, zero_filled, zero_drained, zero_count);
+	kprintf("vm: fault-around: window %u, %u reads read ahead "
+		"%u pages\n", fa_window, fa_reads, fa_pages);
+	textcache_printstats();
+	zswap_printstats();
+	exectrace_printstats();
+	vm_tlb_printstats();
+}
+
+int
+vm_setfaultaround(unsigned npages)
+{
+	if (npages > VM_FAULTAROUND_MAX) {
+		return EINVAL;
+	}
+	fa_window = npages;
+	return 0;
+}
+
+unsigned
+vm_faultaround(void)
+{
+	return fa_window;
+}
+
+/*
+ * True if page VA of region VR has nothing from a file in it.
+ */
+static
+bool
+vm_zerofill(struct vm_region *vr, vaddr_t va)
+{
+	return vr->vr_vnode == NULL || va + PAGE_SIZE <= vr->vr_filebase ||
+		va >= vr->vr_filebase + vr->vr_filesize;
+}
+
+/*
+ * Make PADDR, just filled in, the resident page VA of region VR of
+ * AS, whose entry is PTE.
+ *
+ * Pages of executables' read-only regions go into the text cache, if
+ * they aren't there already, and are then copy-on-write like any
+ * other shared frame. Called with coremap_lock held.
+ */
+static
+void
+_vm_setpage(struct addrspace *as, struct vm_region *vr, vaddr_t va,
+	    pte_t *pte, paddr_t paddr)
+{
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+
+	*pte = paddr | PTE_VALID;
+	_coremap_setowner(paddr, as, va);
+	if (textcache_eligible(vr) && _textcache_insert(vr, va, paddr)) {
+		*pte |= PTE_COW;
+	}
+}
+
+/*
+ * Fill the new frame at PADDR for page VA of region VR, which isn't a
+ * zero-fill page. Whatever part of the page is backed by the file is
+ * read from it; the rest is zeroed.
+ */
+static
+int
+vm_pagein(struct vm_region *vr, vaddr_t va, paddr_t paddr)
+{
+	struct iovec iov;
+	struct uio ku;
+	vaddr_t start, end, fileend;
+	int result;
+
+	KASSERT(!vm_zerofill(vr, va));
+
+	start = va;
+	end = va + PAGE_SIZE;
+	fileend = vr->vr_filebase + vr->vr_filesize;
+
+	if (start < vr->vr_filebase) {
+		start = vr->vr_filebase;
+	}
+	if (end > fileend) {
+		end = fileend;
+	}
+	if (start != va || end != va + PAGE_SIZE) {
+		bzero((void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE);
+	}
+
+	uio_kinit(&iov, &ku, (void *)(PADDR_TO_KVADDR(paddr) + (start - va)),
+		  end - start, vr->vr_fileoff + (start - vr->vr_filebase),
+		  UIO_READ);
+	result = VOP_READ(vr->vr_vnode, &ku);
+	if (result) {
+		return result;
+	}
+	if (ku.uio_resid != 0) {
+		/* short read; problem with executable? */
+		kprintf("vm: short read on segment - file truncated?\n");
+		return ENOEXEC;
+	}
+
+	vmstats_inc(VMSTAT_ELF_FILE_READ);
+	vmstats_inc(VMSTAT_PAGE_FAULT_DISK);
+	return 0;
+}
+
+/*
+ * Read page VA of region VR, which lies entirely within the file, into
+ * the frame at PADDR, along with as many of the following pages of
+ * the file as the fault-around window allows, in a single read. Only
+ * pages that have never been touched are read ahead, and only if a
+ * frame is free for them: this is a guess, so it's not worth evicting
+ * anything for. They are made resident like any other page.
+ *
+ * If the next page is in the text cache already, it is mapped from
+ * there instead, and the read stops short of it: reading it again
+ * would only make a private copy that could never be shared.
+ */
+static
+int
+vm_pagein_ahead(struct addrspace *as, struct vm_region *vr, vaddr_t va,
+		paddr_t paddr)
+{
+	struct iovec iov[1 + VM_FAULTAROUND_MAX];
+	pte_t *ptes[VM_FAULTAROUND_MAX];
+	paddr_t frames[VM_FAULTAROUND_MAX];
+	struct uio ku;
+	vaddr_t next, end;
+	paddr_t cached;
+	bool cacheable;
+	unsigned i, n;
+	int result;
+
+	KASSERT(va >= vr->vr_filebase);
+	KASSERT(va + PAGE_SIZE <= vr->vr_filebase + vr->vr_filesize);
+
+	end = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+	if (end > vr->vr_filebase + vr->vr_filesize) {
+		end = vr->vr_filebase + vr->vr_filesize;
+	}
+
+	/*
+	 * Only this process changes entries that aren't resident, so
+	 * the ones we pick stay empty until we fill them in.
+	 */
+	cacheable = textcache_eligible(vr);
+	n = 0;
+	for (next = va + PAGE_SIZE;
+	     n < fa_window && next + PAGE_SIZE <= end;
+	     next += PAGE_SIZE) {
+		ptes[n] = pt_lookup(as->as_pt, next, true);
+		if (ptes[n] == NULL || *ptes[n] != 0) {
+			break;
+		}
+		if (cacheable) {
+			/* Same as vm_fault: share another process's copy. */
+			spinlock_acquire(&coremap_lock);
+			cached = _textcache_lookup(vr, next);
+			if (cached != 0) {
+				KASSERT(*ptes[n] == 0);
+				*ptes[n] = cached | PTE_VALID | PTE_COW;
+			}
+			spinlock_release(&coremap_lock);
+			if (cached != 0) {
+				break;
+			}
+		}
+		frames[n] = coremap_alloc(1, false);
+		if (frames[n] == 0) {
+			break;
+		}
+		n++;
+	}
+
+	uio_kinit(&iov[0], &ku, (void *)PADDR_TO_KVADDR(paddr), PAGE_SIZE,
+		  vr->vr_fileoff + (va - vr->vr_filebase), UIO_READ);
+	for (i=0; i<n; i++) {
+		iov[i+1].iov_kbase = (void *)PADDR_TO_KVADDR(frames[i]);
+		iov[i+1].iov_len = PAGE_SIZE;
+	}
+	ku.uio_iovcnt = n + 1;
+	ku.uio_resid = (n + 1) * PAGE_SIZE;
+
+	result = VOP_READ(vr->vr_vnode, &ku);
+	if (result == 0 && ku.uio_resid != 0) {
+		kprintf("vm: short read on segment - file truncated?\n");
+		result = ENOEXEC;
+	}
+	if (result) {
+		for (i=0; i<n; i++) {
+			coremap_free(frames[i]);
+		}
+		return result;
+	}
+
+	spinlock_acquire(&coremap_lock);
+	for (i=0; i<n; i++) {
+		KASSERT(*ptes[i] == 0);
+		_vm_setpage(as, vr, va + (i + 1) * PAGE_SIZE, ptes[i],
+			    frames[i]);
+	}
+	spinlock_release(&coremap_lock);
+
+	if (n > 0) {
+		spinlock_acquire(&fa_lock);
+		fa_reads++;
+		fa_pages += n;
+		spinlock_release(&fa_lock);
+	}
+
+	vmstats_inc(VMSTAT_ELF_FILE_READ);
+	vmstats_inc(VMSTAT_PAGE_FAULT_DISK);
+	return 0;
+}
+
+/*
+ * Load TLB entries for the resident pages near VADDR in region VR of
+ * AS, other than VADDR itself. Called with coremap_lock held, which
+ * keeps the pages from being evicted while we do it.
+ */
+static
+void
+vm_preload(struct addrspace *as, struct vm_region *vr, vaddr_t vaddr)
+{
+	vaddr_t va, end;
+	pte_t *pte;
+	bool writable;
+	unsigned i;
+	int dir;
+
+	KASSERT(spinlock_do_i_hold(&coremap_lock));
+
+	end = vr->vr_base + vr->vr_npages * PAGE_SIZE;
+
+	for (dir = -1; dir <= 1; dir += 2) {
+		for (i = 1; i <= fa_window; i++) {
+			va = vaddr + dir * (int)(i * PAGE_SIZE);
+			if (va < vr->vr_base || va >= end) {
+				break;
+			}
+			pte = pt_lookup(as->as_pt, va, false);
+			if (pte == NULL || (*pte & PTE_VALID) == 0 ||
+			    _coremap_busy(*pte & PTE_FRAME)) {
+				continue;
+			}
+			/* Same rules as vm_fault, for a read. */
+			writable = (vr->vr_perms & VR_WRITE) != 0 ||
+				as->as_loading;
+			if ((*pte & PTE_COW) != 0) {
+				writable = false;
+			}
+			vm_tlb_preload(va, *pte & PTE_FRAME, writable);
+		}
+	}
+}
+
+/*
+ * Invalidate the N pages at VADDRS of AS in every TLB that might have
+ * them, and wait until it's done. More than TLBSHOOTDOWN_MAX pages
+ * make the other cpus flush their TLBs instead.
+ *
+ * The cpus to send to are the ones AS has run on, less the one that
+ * did the local invalidate; interrupts are off from one to the other
+ * so that is the cpu we're on. The thread can move before the IPIs go
+ * out, though, possibly to one of those cpus, which doesn't send one
+ * to itself; so that one invalidates again, with interrupts off until
+ * they're sent.
+ */
+void
+vm_shootdown(struct addrspace *as, const vaddr_t *vaddrs, unsigned n)
+{
+	struct tlbshootdown ts[TLBSHOOTDOWN_MAX];
+	uint32_t cpus, self;
+	unsigned i, ncpus;
+	int spl;
+
+	spl = splhigh();
+	for (i=0; i<n; i++) {
+		vm_tlb_invalidate(as, vaddrs[i]);
+	}
+	cpus = vm_tlb_cpus(as) & ~((uint32_t)1 << curcpu->c_number);
+	splx(spl);
+
+	if (cpus == 0) {
+		/* Nobody else has run it; no need for the lock either. */
+		spinlock_acquire(&shootdown_statlock);
+		shootdown_count++;
+		shootdown_local++;
+		spinlock_release(&shootdown_statlock);
+		return;
+	}
+
+	for (i=0; i<n && i<TLBSHOOTDOWN_MAX; i++) {
+		ts[i].ts_addrspace = as;
+		ts[i].ts_vaddr = vaddrs[i];
+	}
+
+	lock_acquire(shootdown_lock);
+	spl = splhigh();
+	self = (uint32_t)1 << curcpu->c_number;
+	if ((cpus & self) != 0) {
+		for (i=0; i<n; i++) {
+			vm_tlb_invalidate(as, vaddrs[i]);
+		}
+		cpus &= ~self;
+	}
+	/* (With N too big, only the count is looked at.) */
+	ncpus = ipi_tlbshootdown_cpus(cpus, ts, n);
+	splx(spl);
+	for (i=0; i<ncpus; i++) {
+		P(shootdown_sem);
+	}
+	lock_release(shootdown_lock);
+
+	spinlock_acquire(&shootdown_statlock);
+	shootdown_count++;
+	if (ncpus == 0) {
+		shootdown_local++;
+	}
+	shootdown_ipis += ncpus;
+	if (n > TLBSHOOTDOWN_MAX) {
+		shootdown_flushes += ncpus;
+	}
+	else {
+		shootdown_entries += n * ncpus;
+	}
+	spinlock_release(&shootdown_statlock);
+}
+
+void
+vm_tlbshootdown_all(void)
+{
+	vm_tlb_flush();
+	V(shootdown_sem);
+}
+
+void
+vm_tlbshootdown(const struct tlbshootdown *ts, int n)
+{
+	int i;
+
+	/*
+	 * The entries may be there even if this cpu is running some
+	 * other process now, since entries are tagged by address space.
+	 */
+	for (i=0; i<n; i++) {
+		vm_tlb_invalidate(ts[i].ts_addrspace, ts[i].ts_vaddr);
+	}
+	V(shootdown_sem);
+}
+
+/*
+ * Evict some user page to swap. The frame it was in is returned,
+ * allocated afresh to the caller as a kernel or user frame. Returns 0
+ * if there is no swap space or nothing that can be evicted.
+ */
+static
+paddr_t
+vm_evict(bool kernel)
+{
+	struct addrspace *as;
+	vaddr_t vaddr;
+	pte_t *pte;
+	paddr_t paddr;
+	unsigned slot;
+	int result;
+
+	if (swap_alloc(&slot)) {
+		return 0;
+	}
+
+	spinlock_acquire(&coremap_lock);
+	paddr = _coremap_victim(&as, &vaddr);
+	if (paddr == 0) {
+		spinlock_release(&coremap_lock);
+		swap_free(slot);
+		return 0;
+	}
+	pte = pt_lookup(as->as_pt, vaddr, false);
+	KASSERT(pte != NULL);
+	KASSERT((*pte & (PTE_VALID | PTE_FRAME)) == (paddr | PTE_VALID));
+	spinlock_release(&coremap_lock);
+
+	/*
+	 * The frame is busy now, so anyone who faults on it will wait.
+	 * Once no TLB maps it, nobody can change it under us.
+	 */
+	vm_shootdown(as, &vaddr, 1);
+
+	spinlock_acquire(&coremap_lock);
+	if (_textcache_remove(paddr)) {
+		/* Text can just be read from the file again. */
+		DEBUG(DB_VM, "vm: dropping text page 0x%x (0x%x)\n",
+		      vaddr, paddr);
+		*pte = 0;
+		_coremap_reuse(paddr, kernel);
+		spinlock_release(&coremap_lock);
+		swap_free(slot);
+		return paddr;
+	}
+	spinlock_release(&coremap_lock);
+
+	DEBUG(DB_VM, "vm: evicting 0x%x (0x%x) to slot %u\n",
+	      vaddr, paddr, slot);
+	result = swap_out(slot, paddr);
+
+	spinlock_acquire(&coremap_lock);
+	if (result) {
+		kprintf("vm: swap write failed: %s\n", strerror(result));
+		_coremap_unbusy(paddr);
+		spinlock_release(&coremap_lock);
+		swap_free(slot);
+		return 0;
+	}
+	*pte = PTE_MKSWAP(slot);
+	_coremap_reuse(paddr, kernel);
+	spinlock_release(&coremap_lock);
+
+	return paddr;
+}
+
+/*
+ * Handle a write to the copy-on-write page VADDR of AS, whose entry
+ * is PTE. Called and returns with coremap_lock held, but may release
+ * it. If the entry changed meanwhile, returns EAGAIN and the caller
+ * should look at it again. Sets *COPIED if the page moved to a new
+ * frame, in which case other cpus may still map the old one.
+ */
+static
+int
+vm_cowfault(struct addrspace *as, vaddr_t vaddr, pte_t *pte, bool *copied)
+{
+	pte_t oldpte;
+	paddr_t oldpa, newpa;
+
+	oldpte = *pte;
+	oldpa = oldpte & PTE_FRAME;
+
+	/*
+	 * Only this address space can add references to the frame
+	 * (by forking), and it's busy faulting, so if we hold the last
+	 * one it stays that way.
+	 */
+	if (_coremap_refcount(oldpa) == 1) {
+		/* If it's a cached text page, it's ours now. */
+		_textcache_remove(oldpa);
+		*pte &= ~(pte_t)PTE_COW;
+		spinlock_acquire(&cow_lock);
+		cow_reclaimed++;
+		spinlock_release(&cow_lock);
+		return 0;
+	}
+
+	/* Shared frames are never evicted, but it might stop being shared. */
+	spinlock_release(&coremap_lock);
+	newpa = alloc_upage();
+	spinlock_acquire(&coremap_lock);
+	if (newpa == 0) {
+		return ENOMEM;
+	}
+	if (*pte != oldpte || _coremap_busy(oldpa)) {
+		_coremap_free(newpa);
+		return EAGAIN;
+	}
+
+	memmove((void *)PADDR_TO_KVADDR(newpa),
+		(const void *)PADDR_TO_KVADDR(oldpa), PAGE_SIZE);
+	*pte = newpa | PTE_VALID;
+	_coremap_free(oldpa);
+	_coremap_setowner(newpa, as, vaddr);
+	*copied = true;
+
+	spinlock_acquire(&cow_lock);
+	cow_copied++;
+	spinlock_release(&cow_lock);
+	return 0;
+}
+
+/*
+ * Make the non-resident page VADDR of region VR, whose entry is PTE,
+ * resident. Called without coremap_lock; only the owning process
+ * ever changes an entry that isn't resident. Adds what it took to
+ * *WHAT, for faultstat_record.
+ */
+static
+int
+vm_pagefault(struct addrspace *as, struct vm_region *vr, vaddr_t vaddr,
+	     pte_t *pte, unsigned *what)
+{
+	pte_t oldpte;
+	paddr_t paddr;
+	int result;
+
+	oldpte = *pte;
+	KASSERT((oldpte & PTE_VALID) == 0);
+
+	if ((oldpte & PTE_SWAPPED) == 0 && textcache_eligible(vr) &&
+	    !vm_zerofill(vr, vaddr)) {
+		/* Maybe another process running this program has it. */
+		spinlock_acquire(&coremap_lock);
+		paddr = _textcache_lookup(vr, vaddr);
+		if (paddr != 0) {
+			KASSERT(*pte == oldpte);
+			*pte = paddr | PTE_VALID | PTE_COW;
+			spinlock_release(&coremap_lock);
+			/* It was in memory all along. */
+			vmstats_inc(VMSTAT_TLB_RELOAD);
+			return 0;
+		}
+		spinlock_release(&coremap_lock);
+	}
+
+	if ((oldpte & PTE_SWAPPED) == 0 && vm_zerofill(vr, vaddr)) {
+		paddr = vm_zeropage();
+		if (paddr == 0) {
+			return ENOMEM;
+		}
+		vmstats_inc(VMSTAT_PAGE_FAULT_ZERO);
+		*what |= 1U << FAULTSTAT_ZERO;
+	}
+	else {
+		paddr = alloc_upage();
+		if (paddr == 0) {
+			return ENOMEM;
+		}
+		if (oldpte & PTE_SWAPPED) {
+			result = swap_in(PTE_SLOT(oldpte), paddr);
+			*what |= 1U << FAULTSTAT_SWAPIN;
+		}
+		else if (fa_window > 0 && vaddr >= vr->vr_filebase &&
+			 vaddr + PAGE_SIZE <=
+			 vr->vr_filebase + vr->vr_filesize) {
+			/* A whole page from the file; read ahead too. */
+			result = vm_pagein_ahead(as, vr, vaddr, paddr);
+		}
+		else {
+			result = vm_pagein(vr, vaddr, paddr);
+		}
+		if (result) {
+			free_upage(paddr);
+			return result;
+		}
+		if ((oldpte & PTE_SWAPPED) == 0) {
+			*what |= 1U << FAULTSTAT_FILE;
+		}
+	}
+
+	spinlock_acquire(&coremap_lock);
+	KASSERT(*pte == oldpte);
+	_vm_setpage(as, vr, vaddr, pte, paddr);
+	if (oldpte & PTE_SWAPPED) {
+		swap_free(PTE_SLOT(oldpte));
+	}
+	spinlock_release(&coremap_lock);
+	return 0;
+}
+
+/*
+ * Read in whichever of the NPAGES pages at VADDR of AS, the current
+ * address space, are file pages that aren't resident yet, ahead of
+ * their being touched. Pages next to each other are read together,
+ * as far as the fault-around window goes. Stops early if free memory
+ * runs low. Returns the number of pages read in.
+ */
+unsigned
+vm_prefetch(struct addrspace *as, vaddr_t vaddr, unsigned npages)
+{
+	struct vm_region *vr;
+	pte_t *pte;
+	unsigned i, n, what;
+
+	KASSERT(as == curproc_getas());
+
+	n = 0;
+	for (i=0; i<npages; i++, vaddr += PAGE_SIZE) {
+		if (coremap_nfree() < VM_PREFETCH_MINFREE) {
+			break;
+		}
+		vr = as_find_region(as, vaddr);
+		if (vr == NULL || vr->vr_vnode == NULL ||
+		    vm_zerofill(vr, vaddr)) {
+			continue;
+		}
+		pte = pt_lookup(as->as_pt, vaddr, true);
+		if (pte == NULL) {
+			break;
+		}
+		/* Only we make entries resident, so this can't change. */
+		if ((*pte & (PTE_VALID | PTE_SWAPPED)) != 0) {
+			continue;
+		}
+		what = 0;
+		if (vm_pagefault(as, vr, vaddr, pte, &what)) {
+			break;
+		}
+		n++;
+	}
+	return n;
+}
+
+/*
+ * The guts of vm_fault. Sets *WHAT to what handling the fault took.
+ */
+static
+int
+vm_dofault(int faulttype, vaddr_t faultaddress, unsigned *what)
+{
+	struct addrspace *as;
+	struct vm_region *vr;
+	pte_t *pte;
+	paddr_t paddr;
+	bool writing, writable, pagedin, copied;
+	int result;
+
+	faultaddress &= PAGE_FRAME;
+
+	DEBUG(DB_VM, "vm: fault: 0x%x\n", faultaddress);
+
+	switch (faulttype) {
+	    case VM_FAULT_READONLY:
+		/*
+		 * Either a copy-on-write page or a write to a
+		 * read-only region; which one is sorted out below.
+		 */
+	    case VM_FAULT_READ:
+	    case VM_FAULT_WRITE:
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	if (curproc == NULL) {
+		/*
+		 * No process. This is probably a kernel fault early
+		 * in boot. Return EFAULT so as to panic instead of
+		 * getting into an infinite faulting loop.
+		 */
+		return EFAULT;
+	}
+
+	as = curproc_getas();
+	if (as == NULL) {
+		/*
+		 * No address space set up. This is probably also a
+		 * kernel fault early in boot.
+		 */
+		return EFAULT;
+	}
+
+	vr = as_find_region(as, faultaddress);
+	if (vr == NULL) {
+		/* Maybe it's just below the stack. */
+		vr = as_grow_stack(as, faultaddress);
+		if (vr == NULL) {
+			return EFAULT;
+		}
+	}
+
+	/* While loading, the ELF loader writes into read-only text. */
+	writing = faulttype != VM_FAULT_READ;
+	writable = (vr->vr_perms & VR_WRITE) != 0 || as->as_loading;
+	if (writing && !writable) {
+		return EFAULT;
+	}
+	if (vr->vr_perms == 0 && !as->as_loading) {
+		/* mprotect(PROT_NONE) */
+		return EFAULT;
+	}
+
+	pte = pt_lookup(as->as_pt, faultaddress, true);
+	if (pte == NULL) {
+		return ENOMEM;
+	}
+
+	pagedin = false;
+	copied = false;
+	spinlock_acquire(&coremap_lock);
+ again:
+	while ((*pte & PTE_VALID) != 0 && _coremap_busy(*pte & PTE_FRAME)) {
+		/* Being evicted; wait, then read it back in. */
+		_coremap_wait();
+	}
+
+	if ((*pte & PTE_VALID) == 0) {
+		spinlock_release(&coremap_lock);
+		result = vm_pagefault(as, vr, faultaddress, pte, what);
+		if (result) {
+			return result;
+		}
+		pagedin = true;
+		spinlock_acquire(&coremap_lock);
+		goto again;
+	}
+
+	if (writing && (*pte & PTE_COW) != 0) {
+		result = vm_cowfault(as, faultaddress, pte, &copied);
+		if (result == EAGAIN) {
+			goto again;
+		}
+		if (result) {
+			spinlock_release(&coremap_lock);
+			return result;
+		}
+		*what |= 1U << FAULTSTAT_COW;
+		if (copied) {
+			/*
+			 * TLB entries survive address space switches,
+			 * so a cpu this process ran on before may
+			 * still map the old frame.
+			 */
+			spinlock_release(&coremap_lock);
+			vm_shootdown(as, &faultaddress, 1);
+			copied = false;
+			spinlock_acquire(&coremap_lock);
+			goto again;
+		}
+	}
+	paddr = *pte & PTE_FRAME;
+
+	/* make sure it's page-aligned */
+	KASSERT((paddr & PAGE_FRAME) == paddr);
+
+	/* Shared pages stay read-only until someone writes them. */
+	if ((*pte & PTE_COW) != 0) {
+		writable = false;
+	}
+
+	/*
+	 * Load the TLB before letting go of the lock, so the page
+	 * can't be picked for eviction in between.
+	 */
+	if (vr->vr_vnode != NULL && !vm_zerofill(vr, faultaddress)) {
+		exectrace_note(as, vr, faultaddress);
+	}
+	_coremap_touch(paddr, as, faultaddress);
+	DEBUG(DB_VM, "vm: 0x%x -> 0x%x\n", faultaddress, paddr);
+	if (!pagedin) {
+		vmstats_inc(VMSTAT_TLB_RELOAD);
+	}
+	vmstats_inc(VMSTAT_TLB_FAULT);
+	*what |= 1U << FAULTSTAT_TLB;
+	result = vm_tlb_load(faultaddress, paddr, writable);
+	if (result == 0 && fa_window > 0) {
+		vm_preload(as, vr, faultaddress);
+	}
+
+	spinlock_release(&coremap_lock);
+	return result;
+}
+
+/*
+ * Handle a fault, timing it by the clock (the ltimer's) for the
+ * fault statistics. Faults that fail aren't counted.
+ */
+int
+vm_fault(int faulttype, vaddr_t faultaddress)
+{
+	time_t startsecs, endsecs;
+	uint32_t startnsecs, endnsecs, nsecs;
+	unsigned what;
+	int result;
+
+	gettime(&startsecs, &startnsecs);
+	what = 0;
+	result = vm_dofault(faulttype, faultaddress, &what);
+	if (result) {
+		return result;
+	}
+	gettime(&endsecs, &endnsecs);
+
+	if (endsecs - startsecs >= 4) {
+		/* Doesn't fit; it goes in the last bucket anyway. */
+		nsecs = 0xffffffff;
+	}
+	else {
+		nsecs = (endsecs - startsecs) * 1000000000 +
+			endnsecs - startnsecs;
+	}
+	faultstat_record(what, nsecs);
+	return 0;
+}
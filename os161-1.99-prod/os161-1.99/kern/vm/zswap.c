@@ -0,0 +1,749 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <coremap.h>
+#include <zswap.h>
+#include <vm.h>
+
+/*
+ * Compressed swap cache.
+ *
+ * The pool starts out with 1/ZS_FLOOR of its largest size, taken from
+ * the coremap at boot and kept for good: pages are only ever stored
+ * from vm_evict, once the coremap has run dry, so a pool that had to
+ * grow then would never get anywhere. Beyond that floor it grows a
+ * frame at a time, when a page doesn't fit and the coremap happens to
+ * have one, up to 1/ZS_FRACTION of memory (at most ZS_MAXPAGES
+ * frames). zswap_shrink gives back the frames above the floor that
+ * are empty when memory runs short.
+ *
+ * Each pool frame is cut into blocks of ZS_BLOCKSIZE bytes, numbered
+ * so that block b is on pool page b / ZS_BLOCKSPERPAGE. A compressed
+ * page is kept in a chain of blocks, in order: zs_next links each
+ * block to the next one in its chain, or, for a free block, to the
+ * next free one on the same pool page. Blocks are taken from the
+ * lowest-numbered page that has any, so the pages at the top tend to
+ * empty out and can be given back. The floor's frames are the first
+ * pages, so they are the ones that fill. A page that takes more than
+ * ZS_MAXBLOCKS blocks isn't compressing well enough to be worth
+ * keeping.
+ *
+ * zs_slots has, for each swap slot, the first block and compressed
+ * length of its page, or a length of 0 if the page isn't in the pool.
+ * The pages in the pool are also on a list from oldest to newest.
+ * When the pool is full and can't grow, zswap_store fails with ENOSPC
+ * and the swap code writes the oldest page out to its own slot on
+ * disk (see zswap_oldest) to make room, rather than sending the new
+ * page to disk.
+ *
+ * The pool is protected by zs_spinlock, since zswap_drop is called
+ * with spinlocks held. Compressing and decompressing take too long to
+ * do under it, so they're done in a scratch buffer protected by
+ * zs_scratchlock, which is taken first. Only zswap_store adds frames
+ * to the pool, under zs_scratchlock, so only one thread grows it at a
+ * time.
+ *
+ * The codec is a byte-oriented LZ77 like LZ4's: the page is coded as
+ * a series of sequences, each a run of literal bytes followed by a
+ * match, a copy of earlier output. Each sequence starts with a token
+ * byte holding the literal count in its top four bits and the match
+ * length (less LZ_MINMATCH) in the bottom four. A count of 15 means
+ * the rest follows, as bytes of 255 and a final byte less than 255.
+ * Then come the literals, the match offset (two bytes, low first),
+ * and the rest of the match length. The last sequence has no match;
+ * the page ends after its literals. Matches are found with a hash of
+ * the next LZ_MINMATCH bytes, remembering one earlier position per
+ * hash value.
+ */
+
+#define ZS_FRACTION       8
+#define ZS_MAXPAGES       1024
+#define ZS_FLOOR          2
+#define ZS_BLOCKSIZE      128
+#define ZS_BLOCKSPERPAGE  (PAGE_SIZE / ZS_BLOCKSIZE)
+#define ZS_MAXBLOCKS      (ZS_BLOCKSPERPAGE * 3 / 4)
+#define ZS_NOBLOCK        0xffff
+#define ZS_NOSLOT         0xffffffff
+
+#define LZ_MINMATCH   4
+#define LZ_HASHBITS   10
+#define LZ_MAXOFFSET  0xffff
+
+struct zs_slot {
+	uint16_t zs_first;	/* first block */
+	uint16_t zs_len;	/* compressed length; 0 if not here */
+	uint32_t zs_older;	/* age list: next older, or ZS_NOSLOT */
+	uint32_t zs_newer;	/* ...next newer */
+	bool zs_listed;		/* on the age list */
+};
+
+static unsigned zs_maxpages;		/* 0 if there is no pool */
+static vaddr_t *zs_pages;		/* pool frames; 0 for none */
+static uint16_t *zs_pagefree;		/* first free block, per page */
+static uint8_t *zs_pagenfree;		/* free blocks, per page */
+static unsigned zs_npages;		/* pool frames now */
+static unsigned zs_minpages;		/* ...never fewer than this */
+static unsigned zs_lowpage;		/* no free blocks below this page */
+static uint16_t *zs_next;		/* next block in chain */
+static unsigned zs_nfree;		/* free blocks on all pages */
+static struct zs_slot *zs_slots;
+static unsigned zs_nslots;
+static uint32_t zs_oldest;		/* age list */
+static uint32_t zs_newest;
+static struct spinlock zs_spinlock = SPINLOCK_INITIALIZER;
+
+static struct lock *zs_scratchlock;
+static uint8_t zs_scratch[ZS_MAXBLOCKS * ZS_BLOCKSIZE];
+static uint16_t lz_table[1 << LZ_HASHBITS];
+
+/* Statistics, also under zs_spinlock. */
+static unsigned zs_stored;		/* pages stored */
+static uint64_t zs_storedbytes;		/* their compressed size */
+static unsigned zs_incompressible;	/* pages that went to disk */
+static unsigned zs_full;		/* stores that found the pool full */
+static unsigned zs_written;		/* pages written back for room */
+static unsigned zs_hits;		/* pages read back from the pool */
+static unsigned zs_misses;		/* pages read from disk */
+static unsigned zs_held;		/* pages in the pool now */
+static unsigned zs_grown;		/* frames added to the pool */
+static unsigned zs_shrunk;		/* ...and given back */
+
+static
+uint32_t
+lz_read32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static
+unsigned
+lz_hash(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - LZ_HASHBITS);
+}
+
+/*
+ * Write the part N of a length that didn't fit in its token.
+ */
+static
+size_t
+lz_putlen(uint8_t *dst, size_t op, size_t n)
+{
+	while (n >= 255) {
+		dst[op++] = 255;
+		n -= 255;
+	}
+	dst[op++] = n;
+	return op;
+}
+
+/*
+ * Append a sequence of LITLEN literals from LIT and a match of MLEN
+ * bytes OFFSET back (none if MLEN is 0) to DST, which has OP bytes
+ * already and room for MAX. Returns the new length, or 0 if it
+ * doesn't fit.
+ */
+static
+size_t
+lz_emit(uint8_t *dst, size_t op, size_t max, const uint8_t *lit,
+	size_t litlen, size_t offset, size_t mlen)
+{
+	unsigned tlit, tmatch;
+
+	/* The most it can take. */
+	if (op + 1 + litlen / 255 + 1 + litlen + 2 + mlen / 255 + 1 > max) {
+		return 0;
+	}
+
+	tlit = litlen < 15 ? litlen : 15;
+	tmatch = 0;
+	if (mlen > 0) {
+		tmatch = mlen - LZ_MINMATCH < 15 ? mlen - LZ_MINMATCH : 15;
+	}
+	dst[op++] = (tlit << 4) | tmatch;
+	if (tlit == 15) {
+		op = lz_putlen(dst, op, litlen - 15);
+	}
+	memcpy(dst + op, lit, litlen);
+	op += litlen;
+
+	if (mlen > 0) {
+		dst[op++] = offset & 0xff;
+		dst[op++] = offset >> 8;
+		if (tmatch == 15) {
+			op = lz_putlen(dst, op, mlen - LZ_MINMATCH - 15);
+		}
+	}
+	return op;
+}
+
+/*
+ * Compress LEN bytes from SRC into DST, which has room for MAX.
+ * Returns the compressed length, or 0 if it doesn't fit.
+ */
+static
+size_t
+lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t max)
+{
+	size_t ip, anchor, ref, mlen, op;
+	unsigned h;
+
+	KASSERT(len <= LZ_MAXOFFSET);
+
+	bzero(lz_table, sizeof(lz_table));
+	ip = anchor = op = 0;
+	while (ip + LZ_MINMATCH <= len) {
+		h = lz_hash(lz_read32(src + ip));
+		ref = lz_table[h];
+		lz_table[h] = ip;
+		if (ref >= ip || lz_read32(src + ref) != lz_read32(src + ip)) {
+			ip++;
+			continue;
+		}
+
+		mlen = LZ_MINMATCH;
+		while (ip + mlen < len && src[ref + mlen] == src[ip + mlen]) {
+			mlen++;
+		}
+		op = lz_emit(dst, op, max, src + anchor, ip - anchor,
+			     ip - ref, mlen);
+		if (op == 0) {
+			return 0;
+		}
+		ip += mlen;
+		anchor = ip;
+	}
+
+	if (anchor < len) {
+		op = lz_emit(dst, op, max, src + anchor, len - anchor, 0, 0);
+	}
+	return op;
+}
+
+/*
+ * Read the rest of a length into *N.
+ */
+static
+size_t
+lz_getlen(const uint8_t *src, size_t ip, size_t *n)
+{
+	uint8_t b;
+
+	do {
+		b = src[ip++];
+		*n += b;
+	} while (b == 255);
+	return ip;
+}
+
+/*
+ * Decompress SRCLEN bytes from SRC into the LEN bytes at DST.
+ */
+static
+void
+lz_decompress(const uint8_t *src, size_t srclen, uint8_t *dst, size_t len)
+{
+	size_t ip, op, n, offset;
+	unsigned token;
+
+	ip = op = 0;
+	while (op < len) {
+		KASSERT(ip < srclen);
+		token = src[ip++];
+
+		n = token >> 4;
+		if (n == 15) {
+			ip = lz_getlen(src, ip, &n);
+		}
+		KASSERT(op + n <= len && ip + n <= srclen);
+		memcpy(dst + op, src + ip, n);
+		ip += n;
+		op += n;
+		if (op == len) {
+			break;
+		}
+
+		offset = src[ip] | (src[ip + 1] << 8);
+		ip += 2;
+		n = token & 15;
+		if (n == 15) {
+			ip = lz_getlen(src, ip, &n);
+		}
+		n += LZ_MINMATCH;
+		KASSERT(offset > 0 && offset <= op && op + n <= len);
+		/* Byte at a time: the match may overlap what it makes. */
+		for (; n > 0; n--, op++) {
+			dst[op] = dst[op - offset];
+		}
+	}
+	KASSERT(ip == srclen);
+}
+
+static
+void *
+zs_block(unsigned b)
+{
+	KASSERT(b < zs_maxpages * ZS_BLOCKSPERPAGE);
+	KASSERT(zs_pages[b / ZS_BLOCKSPERPAGE] != 0);
+	return (void *)(zs_pages[b / ZS_BLOCKSPERPAGE] +
+			(b % ZS_BLOCKSPERPAGE) * ZS_BLOCKSIZE);
+}
+
+/*
+ * Take a free block from the lowest page that has one.
+ */
+static
+unsigned
+zs_getblock(void)
+{
+	unsigned p, b;
+
+	KASSERT(spinlock_do_i_hold(&zs_spinlock));
+	KASSERT(zs_nfree > 0);
+
+	p = zs_lowpage;
+	while (zs_pagenfree[p] == 0) {
+		p++;
+		KASSERT(p < zs_maxpages);
+	}
+	zs_lowpage = p;
+
+	b = zs_pagefree[p];
+	zs_pagefree[p] = zs_next[b];
+	zs_pagenfree[p]--;
+	zs_nfree--;
+	return b;
+}
+
+/*
+ * Put block B back on its page's free list.
+ */
+static
+void
+zs_putblock(unsigned b)
+{
+	unsigned p;
+
+	KASSERT(spinlock_do_i_hold(&zs_spinlock));
+
+	p = b / ZS_BLOCKSPERPAGE;
+	zs_next[b] = zs_pagefree[p];
+	zs_pagefree[p] = b;
+	zs_pagenfree[p]++;
+	zs_nfree++;
+	if (p < zs_lowpage) {
+		zs_lowpage = p;
+	}
+}
+
+/*
+ * Add the frame at PADDR to the pool, in the first unused page.
+ */
+static
+void
+zs_addpage(paddr_t paddr)
+{
+	unsigned p, i, b;
+
+	KASSERT(spinlock_do_i_hold(&zs_spinlock));
+	KASSERT(zs_npages < zs_maxpages);
+
+	for (p=0; zs_pages[p] != 0; p++) {
+		KASSERT(p < zs_maxpages);
+	}
+	zs_pages[p] = PADDR_TO_KVADDR(paddr);
+
+	b = p * ZS_BLOCKSPERPAGE;
+	for (i=0; i<ZS_BLOCKSPERPAGE; i++) {
+		zs_next[b + i] = i + 1 < ZS_BLOCKSPERPAGE ? b + i + 1 :
+			ZS_NOBLOCK;
+	}
+	zs_pagefree[p] = b;
+	zs_pagenfree[p] = ZS_BLOCKSPERPAGE;
+	zs_nfree += ZS_BLOCKSPERPAGE;
+	if (p < zs_lowpage) {
+		zs_lowpage = p;
+	}
+	zs_npages++;
+	zs_grown++;
+}
+
+/*
+ * Age list operations. Caller holds zs_spinlock.
+ */
+static
+void
+zs_list(unsigned slot)
+{
+	struct zs_slot *zs = &zs_slots[slot];
+
+	KASSERT(!zs->zs_listed);
+	zs->zs_older = zs_newest;
+	zs->zs_newer = ZS_NOSLOT;
+	if (zs_newest != ZS_NOSLOT) {
+		zs_slots[zs_newest].zs_newer = slot;
+	}
+	else {
+		zs_oldest = slot;
+	}
+	zs_newest = slot;
+	zs->zs_listed = true;
+}
+
+static
+void
+zs_unlist(unsigned slot)
+{
+	struct zs_slot *zs = &zs_slots[slot];
+
+	KASSERT(zs->zs_listed);
+	if (zs->zs_older != ZS_NOSLOT) {
+		zs_slots[zs->zs_older].zs_newer = zs->zs_newer;
+	}
+	else {
+		zs_oldest = zs->zs_newer;
+	}
+	if (zs->zs_newer != ZS_NOSLOT) {
+		zs_slots[zs->zs_newer].zs_older = zs->zs_older;
+	}
+	else {
+		zs_newest = zs->zs_older;
+	}
+	zs->zs_listed = false;
+}
+
+void
+zswap_bootstrap(unsigned nslots)
+{
+	unsigned maxpages, i;
+	paddr_t pa;
+
+	maxpages = coremap_nframes() / ZS_FRACTION;
+	if (maxpages > ZS_MAXPAGES) {
+		maxpages = ZS_MAXPAGES;
+	}
+	if (maxpages == 0) {
+		return;
+	}
+
+	zs_scratchlock = lock_create("zswap");
+	zs_slots = kmalloc(nslots * sizeof(zs_slots[0]));
+	zs_pages = kmalloc(maxpages * sizeof(zs_pages[0]));
+	zs_pagefree = kmalloc(maxpages * sizeof(zs_pagefree[0]));
+	zs_pagenfree = kmalloc(maxpages * sizeof(zs_pagenfree[0]));
+	zs_next = kmalloc(maxpages * ZS_BLOCKSPERPAGE * sizeof(zs_next[0]));
+	if (zs_scratchlock == NULL || zs_slots == NULL || zs_pages == NULL ||
+	    zs_pagefree == NULL || zs_pagenfree == NULL || zs_next == NULL) {
+		kprintf("zswap: out of memory; swapping straight to disk\n");
+		if (zs_scratchlock != NULL) {
+			lock_destroy(zs_scratchlock);
+		}
+		kfree(zs_slots);
+		kfree(zs_pages);
+		kfree(zs_pagefree);
+		kfree(zs_pagenfree);
+		kfree(zs_next);
+		return;
+	}
+
+	for (i=0; i<nslots; i++) {
+		zs_slots[i].zs_len = 0;
+		zs_slots[i].zs_listed = false;
+	}
+	zs_nslots = nslots;
+	zs_oldest = zs_newest = ZS_NOSLOT;
+
+	for (i=0; i<maxpages; i++) {
+		zs_pages[i] = 0;
+		zs_pagenfree[i] = 0;
+	}
+	zs_npages = 0;
+	zs_lowpage = 0;
+	zs_nfree = 0;
+	zs_maxpages = maxpages;
+
+	/* The floor. */
+	for (i=0; i<DIVROUNDUP(maxpages, ZS_FLOOR); i++) {
+		pa = coremap_alloc(1, true);
+		if (pa == 0) {
+			break;
+		}
+		spinlock_acquire(&zs_spinlock);
+		zs_addpage(pa);
+		spinlock_release(&zs_spinlock);
+	}
+	zs_minpages = zs_npages;
+	zs_grown = 0;
+
+	kprintf("zswap: compressed swap cache of %u to %u pages\n",
+		zs_minpages, maxpages);
+}
+
+int
+zswap_store(unsigned slot, paddr_t paddr)
+{
+	size_t len, n;
+	unsigned nblocks, i, b, prev;
+	paddr_t pa;
+
+	if (zs_maxpages == 0) {
+		return ENOSPC;
+	}
+	KASSERT(slot < zs_nslots);
+
+	lock_acquire(zs_scratchlock);
+
+	len = lz_compress((const uint8_t *)PADDR_TO_KVADDR(paddr), PAGE_SIZE,
+			  zs_scratch, sizeof(zs_scratch));
+	if (len == 0) {
+		lock_release(zs_scratchlock);
+		spinlock_acquire(&zs_spinlock);
+		zs_incompressible++;
+		spinlock_release(&zs_spinlock);
+		return EFBIG;
+	}
+	nblocks = DIVROUNDUP(len, ZS_BLOCKSIZE);
+
+	spinlock_acquire(&zs_spinlock);
+	KASSERT(zs_slots[slot].zs_len == 0);
+	while (zs_nfree < nblocks) {
+		/* Grow, if there's a frame to be had. */
+		if (zs_npages == zs_maxpages || coremap_nfree() == 0) {
+			zs_full++;
+			spinlock_release(&zs_spinlock);
+			lock_release(zs_scratchlock);
+			return ENOSPC;
+		}
+		spinlock_release(&zs_spinlock);
+		pa = coremap_alloc(1, true);
+		spinlock_acquire(&zs_spinlock);
+		if (pa == 0) {
+			continue;
+		}
+		zs_addpage(pa);
+	}
+
+	/* Take the chain a block at a time. */
+	prev = ZS_NOBLOCK;
+	for (i=0; i<nblocks; i++) {
+		b = zs_getblock();
+		n = len - i * ZS_BLOCKSIZE;
+		memcpy(zs_block(b), zs_scratch + i * ZS_BLOCKSIZE,
+		       n < ZS_BLOCKSIZE ? n : ZS_BLOCKSIZE);
+		if (prev == ZS_NOBLOCK) {
+			zs_slots[slot].zs_first = b;
+		}
+		else {
+			zs_next[prev] = b;
+		}
+		prev = b;
+	}
+	zs_next[prev] = ZS_NOBLOCK;
+	zs_slots[slot].zs_len = len;
+	zs_list(slot);
+
+	zs_stored++;
+	zs_storedbytes += len;
+	zs_held++;
+	spinlock_release(&zs_spinlock);
+
+	lock_release(zs_scratchlock);
+	return 0;
+}
+
+/*
+ * Decompress SLOT into the frame at PADDR, if it's still in the pool.
+ */
+static
+bool
+zs_unpack(unsigned slot, paddr_t paddr)
+{
+	size_t len, n;
+	unsigned i, b;
+
+	lock_acquire(zs_scratchlock);
+
+	/* It may have been written back while we waited. */
+	spinlock_acquire(&zs_spinlock);
+	len = zs_slots[slot].zs_len;
+	if (len == 0) {
+		spinlock_release(&zs_spinlock);
+		lock_release(zs_scratchlock);
+		return false;
+	}
+	b = zs_slots[slot].zs_first;
+	for (i=0; i * ZS_BLOCKSIZE < len; i++) {
+		n = len - i * ZS_BLOCKSIZE;
+		memcpy(zs_scratch + i * ZS_BLOCKSIZE, zs_block(b),
+		       n < ZS_BLOCKSIZE ? n : ZS_BLOCKSIZE);
+		b = zs_next[b];
+	}
+	spinlock_release(&zs_spinlock);
+
+	lz_decompress(zs_scratch, len, (uint8_t *)PADDR_TO_KVADDR(paddr),
+		      PAGE_SIZE);
+
+	lock_release(zs_scratchlock);
+	return true;
+}
+
+bool
+zswap_load(unsigned slot, paddr_t paddr)
+{
+	bool found;
+
+	if (zs_maxpages == 0) {
+		return false;
+	}
+	KASSERT(slot < zs_nslots);
+
+	found = zs_unpack(slot, paddr);
+
+	spinlock_acquire(&zs_spinlock);
+	if (found) {
+		zs_hits++;
+	}
+	else {
+		zs_misses++;
+	}
+	spinlock_release(&zs_spinlock);
+	return found;
+}
+
+void
+zswap_drop(unsigned slot)
+{
+	unsigned b, next;
+
+	if (zs_maxpages == 0) {
+		return;
+	}
+	KASSERT(slot < zs_nslots);
+
+	spinlock_acquire(&zs_spinlock);
+	if (zs_slots[slot].zs_len != 0) {
+		/* Put each block back on its own page's free list. */
+		for (b = zs_slots[slot].zs_first; b != ZS_NOBLOCK; b = next) {
+			next = zs_next[b];
+			zs_putblock(b);
+		}
+		if (zs_slots[slot].zs_listed) {
+			zs_unlist(slot);
+		}
+		zs_slots[slot].zs_len = 0;
+		zs_held--;
+	}
+	spinlock_release(&zs_spinlock);
+}
+
+bool
+zswap_oldest(unsigned *slot)
+{
+	if (zs_maxpages == 0) {
+		return false;
+	}
+
+	spinlock_acquire(&zs_spinlock);
+	if (zs_oldest == ZS_NOSLOT) {
+		spinlock_release(&zs_spinlock);
+		return false;
+	}
+	*slot = zs_oldest;
+	zs_unlist(*slot);
+	spinlock_release(&zs_spinlock);
+	return true;
+}
+
+bool
+zswap_writeback(unsigned slot, paddr_t paddr)
+{
+	KASSERT(zs_maxpages > 0);
+	KASSERT(slot < zs_nslots);
+
+	return zs_unpack(slot, paddr);
+}
+
+void
+zswap_written(unsigned slot, bool ok)
+{
+	KASSERT(zs_maxpages > 0);
+	KASSERT(slot < zs_nslots);
+
+	if (ok) {
+		spinlock_acquire(&zs_spinlock);
+		zs_written++;
+		spinlock_release(&zs_spinlock);
+		zswap_drop(slot);
+		return;
+	}
+
+	/* Keep it, and try something else next time. */
+	spinlock_acquire(&zs_spinlock);
+	if (zs_slots[slot].zs_len != 0 && !zs_slots[slot].zs_listed) {
+		zs_list(slot);
+	}
+	spinlock_release(&zs_spinlock);
+}
+
+bool
+zswap_shrink(void)
+{
+	unsigned p, n;
+	vaddr_t page;
+
+	if (zs_maxpages == 0) {
+		return false;
+	}
+
+	n = 0;
+	spinlock_acquire(&zs_spinlock);
+	for (p=zs_maxpages; p-- > zs_minpages; ) {
+		if (zs_pages[p] == 0 ||
+		    zs_pagenfree[p] < ZS_BLOCKSPERPAGE) {
+			continue;
+		}
+		page = zs_pages[p];
+		zs_pages[p] = 0;
+		zs_pagenfree[p] = 0;
+		zs_nfree -= ZS_BLOCKSPERPAGE;
+		zs_npages--;
+		zs_shrunk++;
+		n++;
+
+		/* coremap_lock doesn't nest inside zs_spinlock. */
+		spinlock_release(&zs_spinlock);
+		coremap_free(KVADDR_TO_PADDR(page));
+		spinlock_acquire(&zs_spinlock);
+	}
+	spinlock_release(&zs_spinlock);
+	return n > 0;
+}
+
+void
+zswap_printstats(void)
+{
+	unsigned ratio, hitrate;
+
+	if (zs_maxpages == 0) {
+		kprintf("vm: zswap: off\n");
+		return;
+	}
+
+	ratio = zs_storedbytes == 0 ? 0 :
+		(unsigned)((uint64_t)zs_stored * PAGE_SIZE * 100 /
+			   zs_storedbytes);
+	hitrate = zs_hits + zs_misses == 0 ? 0 :
+		(unsigned)((uint64_t)zs_hits * 100 / (zs_hits + zs_misses));
+	kprintf("vm: zswap: %u pages held in %u frames (%u to %u), "
+		"%u blocks free; %u frames added, %u given back\n",
+		zs_held, zs_npages, zs_minpages, zs_maxpages, zs_nfree,
+		zs_grown, zs_shrunk);
+	kprintf("vm: zswap: %u pages stored, compression ratio %u.%02u; "
+		"%u incompressible; pool full %u times, %u written back\n",
+		zs_stored, ratio / 100, ratio % 100, zs_incompressible,
+		zs_full, zs_written);
+	kprintf("vm: zswap: %u swap-ins from memory, %u from disk "
+		"(%u%% hit rate)\n", zs_hits, zs_misses, hitrate);
+}
@@ -37,8 +37,10 @@
  * kernel includes. This way user-level code doesn't need to know
  * about the kern/ headers.
  */
+#include <kern/faultstat.h>
 #include <kern/fcntl.h>
 #include <kern/ioctl.h>
+#include <kern/mman.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
 #include <kern/time.h>
@@ -118,6 +120,12 @@
 __DEAD void _exit(int code);
 int execv(const char *prog, char *const *args);
 pid_t fork(void);
+/*
+ * For a child that will only execv or _exit: it runs in the parent's
+ * memory instead of a copy, and the parent waits until it has done
+ * one or the other. Saves copying memory that execv would throw away.
+ */
+pid_t vfork(void);
 int waitpid(pid_t pid, int *returncode, int flags);
 /* 
  * Open actually takes either two or three args: the optional third
@@ -147,6 +155,11 @@ int chdir(const char *path);
 
 /* Optional. */
 void *sbrk(int change);
+void *mmap(void *addr, size_t len, int prot, int flags, int filehandle,
+	   off_t offset);
+int munmap(void *addr, size_t len);
+int mprotect(void *addr, size_t len, int prot);
+int faultstat(int which, struct faultstat *fs);
 int getdirentry(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 int readlink(const char *path, char *buf, size_t buflen);
@@ -0,0 +1,120 @@
+/*
+ * spawnbench - compare the cost of starting a child with fork() and
+ * with vfork().
+ *
+ * Usage: spawnbench [count [kbytes]]
+ *
+ * Starts COUNT children (default 200) each way, each of which exits
+ * right away, and reports the average time for the fork/vfork call to
+ * return in the parent. Before starting, the parent dirties KBYTES of
+ * heap (default 256), since the size of the address space is what
+ * fork has to copy (or, copy-on-write, at least share page by page)
+ * and vfork doesn't.
+ *
+ * Only the call itself is timed, not waitpid: waitpid doesn't wait in
+ * this kernel yet, so there is no way to see a forked child finish.
+ * That means the two numbers aren't quite the same thing. vfork
+ * returns once the child has exited, so its time covers the child's
+ * whole life; fork returns as soon as the child exists, and its
+ * children may still be running, alongside later ones, while the
+ * rest are timed.
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+
+#define DEFAULT_COUNT   200
+#define DEFAULT_KBYTES  256
+
+/*
+ * Nanoseconds from START to now.
+ */
+static
+unsigned long long
+elapsed(time_t startsecs, unsigned long startnsecs)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (secs - startsecs) * 1000000000ULL + nsecs - startnsecs;
+}
+
+/*
+ * Start COUNT children with fork (if !USEVFORK) or vfork, and print
+ * the average time for the call to return.
+ */
+static
+void
+spawn(const char *name, int usevfork, unsigned count)
+{
+	time_t secs;
+	unsigned long nsecs;
+	unsigned long long total;
+	unsigned i;
+	int status;
+	pid_t pid;
+
+	total = 0;
+	for (i=0; i<count; i++) {
+		__time(&secs, &nsecs);
+		pid = usevfork ? vfork() : fork();
+		if (pid < 0) {
+			warn("%s", name);
+			return;
+		}
+		if (pid == 0) {
+			_exit(0);
+		}
+		total += elapsed(secs, nsecs);
+
+		/* Untimed; see above. */
+		if (waitpid(pid, &status, 0) < 0) {
+			warn("waitpid");
+			return;
+		}
+	}
+
+	printf("%-6s %u children, %llu.%06llu s, %llu us each\n",
+	       name, count, total / 1000000000, (total % 1000000000) / 1000,
+	       total / count / 1000);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned count, kbytes;
+	char *heap;
+
+	count = DEFAULT_COUNT;
+	kbytes = DEFAULT_KBYTES;
+	if (argc > 1) {
+		count = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		kbytes = atoi(argv[2]);
+	}
+	if (count == 0) {
+		errx(1, "Usage: spawnbench [count [kbytes]]");
+	}
+
+	heap = NULL;
+	if (kbytes > 0) {
+		heap = malloc(kbytes * 1024);
+		if (heap == NULL) {
+			errx(1, "malloc of %u KB failed", kbytes);
+		}
+		memset(heap, 'x', kbytes * 1024);
+	}
+
+	printf("spawnbench: %u children each way, %u KB of heap\n",
+	       count, kbytes);
+	spawn("fork", 0, count);
+	spawn("vfork", 1, count);
+
+	free(heap);
+	return 0;
+}
@@ -198,6 +198,48 @@ test_print_stats(const char *file, const char* func, int line)
   printf("\n");
 }
 
+/* Set byte i of buf to seed + i */
+void
+test_fill(void *buf, size_t len, unsigned int seed)
+{
+  unsigned char *p = buf;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    p[i] = (unsigned char) (seed + i);
+  }
+}
+
+/* Check that buf still holds what test_fill put there */
+int
+test_check(const void *buf, size_t len, unsigned int seed)
+{
+  const unsigned char *p = buf;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    if (p[i] != (unsigned char) (seed + i)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Check that buf is all zero bytes */
+int
+test_zeroed(const void *buf, size_t len)
+{
+  const unsigned char *p = buf;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    if (p[i] != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
 // #define UNIT_TEST
 #ifdef UNIT_TEST
 int
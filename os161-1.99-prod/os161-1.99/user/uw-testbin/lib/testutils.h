@@ -1,8 +1,13 @@
 #ifndef TESTUTILS_H
 #define TESTUTILS_H
 
+#include <sys/types.h>
+
 #define SUCCESS     (0)
 
+/* For tests that work a page at a time */
+#define TEST_PAGE_SIZE  (4096)
+
 #define TEST_EQUAL(a, b, s)  \
   test_equal(a, b, s, __FILE__, __FUNCTION__, __LINE__)
 
@@ -38,6 +43,13 @@ void test_negative(int ret_val, const char *str,
 void test_not_equal(int ret_val, int expected_val, const char *str,
      const char *file, const char* func, int line);
 void test_print_stats(const char *file, const char* func, int line);
+
+/* Memory patterns: test_fill sets byte i of buf to seed + i,
+ * test_check returns 1 if buf still holds that pattern, and
+ * test_zeroed returns 1 if buf is all zero bytes. */
+void test_fill(void *buf, size_t len, unsigned int seed);
+int test_check(const void *buf, size_t len, unsigned int seed);
+int test_zeroed(const void *buf, size_t len);
 void test_reset_stats(void);
 void test_verbose_on(void);
 void test_verbose_off(void);
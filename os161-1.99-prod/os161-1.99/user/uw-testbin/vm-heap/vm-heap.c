@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../lib/testutils.h"
+
+/*
+ * Exercise the heap: odd-sized sbrk calls, the way malloc makes them,
+ * then malloc, free, and a growing buffer copied along as it doubles
+ * (libc has no realloc) until it covers several pages.
+ */
+
+#define NBLOCKS   (64)
+#define MAXGROW   (16 * TEST_PAGE_SIZE)
+
+static
+void
+test_sbrk(void)
+{
+	char *base, *p;
+
+	base = sbrk(0);
+	TEST_NOT_EQUAL((int)base, -1, "sbrk(0) failed");
+	if (base == (void *)-1) {
+		return;
+	}
+	p = sbrk(5);
+	TEST_EQUAL((int)p, (int)base, "sbrk(5) did not return the old break");
+	p = sbrk(3);
+	TEST_EQUAL((int)p, (int)(base + 5),
+		   "sbrk(3) did not return the old break");
+	base[0] = 'a';
+	base[7] = 'b';
+	p = sbrk(TEST_PAGE_SIZE + 100);
+	TEST_EQUAL((int)p, (int)(base + 8),
+		   "sbrk across a page did not return the old break");
+	base[8 + TEST_PAGE_SIZE + 99] = 'c';
+	p = sbrk(-(TEST_PAGE_SIZE + 108));
+	TEST_EQUAL((int)p, (int)(base + TEST_PAGE_SIZE + 108),
+		   "shrinking sbrk did not return the old break");
+	TEST_EQUAL((int)sbrk(0), (int)base, "break did not come back");
+}
+
+static
+void
+test_malloc(void)
+{
+	unsigned char *blocks[NBLOCKS];
+	size_t sizes[NBLOCKS];
+	unsigned i;
+
+	for (i=0; i<NBLOCKS; i++) {
+		sizes[i] = 8 + (i * 397) % 3000;
+		blocks[i] = malloc(sizes[i]);
+		TEST_NOT_EQUAL((int)blocks[i], 0, "malloc failed");
+		if (blocks[i] == NULL) {
+			return;
+		}
+		test_fill(blocks[i], sizes[i], i);
+	}
+	/* Free every other one and allocate them again. */
+	for (i=0; i<NBLOCKS; i+=2) {
+		free(blocks[i]);
+	}
+	for (i=0; i<NBLOCKS; i+=2) {
+		blocks[i] = malloc(sizes[i]);
+		TEST_NOT_EQUAL((int)blocks[i], 0, "malloc after free failed");
+		if (blocks[i] == NULL) {
+			return;
+		}
+		test_fill(blocks[i], sizes[i], i);
+	}
+	for (i=0; i<NBLOCKS; i++) {
+		TEST_EQUAL(test_check(blocks[i], sizes[i], i), 1,
+			   "block contents changed");
+		free(blocks[i]);
+	}
+}
+
+static
+void
+test_grow(void)
+{
+	unsigned char *buf, *bigger;
+	size_t len;
+
+	len = 16;
+	buf = malloc(len);
+	TEST_NOT_EQUAL((int)buf, 0, "malloc failed");
+	if (buf == NULL) {
+		return;
+	}
+	test_fill(buf, len, 7);
+	while (len < MAXGROW) {
+		bigger = malloc(len * 2);
+		TEST_NOT_EQUAL((int)bigger, 0, "malloc while growing failed");
+		if (bigger == NULL) {
+			break;
+		}
+		memcpy(bigger, buf, len);
+		free(buf);
+		buf = bigger;
+		TEST_EQUAL(test_check(buf, len, 7), 1,
+			   "contents lost while growing");
+		len *= 2;
+		test_fill(buf, len, 7);
+	}
+	free(buf);
+}
+
+int
+main()
+{
+	test_sbrk();
+	test_malloc();
+	test_grow();
+	TEST_STATS();
+	return 0;
+}
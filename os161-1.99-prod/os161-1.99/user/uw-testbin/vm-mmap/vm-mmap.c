@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include "../lib/testutils.h"
+
+/*
+ * Exercise anonymous memory mappings: map some pages, check they come
+ * zero-filled, punch a hole with munmap and map it again with
+ * MAP_FIXED, and flip a range read-only and back with mprotect.
+ * File mappings aren't supported yet and should fail with ENODEV.
+ */
+
+#define NPAGES    (8)
+
+int
+main()
+{
+	char *p, *q;
+	unsigned i;
+	int rc;
+
+	p = mmap(NULL, NPAGES * TEST_PAGE_SIZE, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANON, -1, 0);
+	TEST_NOT_EQUAL((int)p, (int)MAP_FAILED, "mmap failed");
+	if (p == MAP_FAILED) {
+		/* Nothing else can be tried. */
+		TEST_STATS();
+		exit(1);
+	}
+	TEST_EQUAL(test_zeroed(p, NPAGES * TEST_PAGE_SIZE), 1,
+		   "new mapping is not zero-filled");
+	for (i=0; i<NPAGES; i++) {
+		test_fill(p + i * TEST_PAGE_SIZE, TEST_PAGE_SIZE, i);
+	}
+
+	/* Unmap pages 2 and 3, then map them again in the same place. */
+	rc = munmap(p + 2 * TEST_PAGE_SIZE, 2 * TEST_PAGE_SIZE);
+	TEST_EQUAL(rc, SUCCESS, "munmap failed");
+	q = mmap(p + 2 * TEST_PAGE_SIZE, 2 * TEST_PAGE_SIZE,
+		 PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_FIXED,
+		 -1, 0);
+	TEST_EQUAL((int)q, (int)(p + 2 * TEST_PAGE_SIZE),
+		   "mmap with MAP_FIXED did not map the hole");
+	if (q == p + 2 * TEST_PAGE_SIZE) {
+		TEST_EQUAL(test_zeroed(q, 2 * TEST_PAGE_SIZE), 1,
+			   "remapped pages are not zero-filled");
+	}
+	for (i=0; i<NPAGES; i++) {
+		if (i == 2 || i == 3) {
+			continue;
+		}
+		TEST_EQUAL(test_check(p + i * TEST_PAGE_SIZE,
+				      TEST_PAGE_SIZE, i), 1,
+			   "munmap disturbed the pages around it");
+	}
+
+	/* Read-only and back; the contents must survive. */
+	rc = mprotect(p + TEST_PAGE_SIZE, 4 * TEST_PAGE_SIZE, PROT_READ);
+	TEST_EQUAL(rc, SUCCESS, "mprotect read-only failed");
+	TEST_EQUAL(test_check(p + TEST_PAGE_SIZE, TEST_PAGE_SIZE, 1), 1,
+		   "read-only page changed");
+	rc = mprotect(p + TEST_PAGE_SIZE, 4 * TEST_PAGE_SIZE,
+		      PROT_READ | PROT_WRITE);
+	TEST_EQUAL(rc, SUCCESS, "mprotect read-write failed");
+	test_fill(p + 4 * TEST_PAGE_SIZE, TEST_PAGE_SIZE, 'z');
+	TEST_EQUAL(test_check(p + 4 * TEST_PAGE_SIZE, TEST_PAGE_SIZE, 'z'), 1,
+		   "write after mprotect was lost");
+
+	rc = munmap(p, NPAGES * TEST_PAGE_SIZE);
+	TEST_EQUAL(rc, SUCCESS, "munmap of the whole mapping failed");
+
+	/* No file mappings yet. */
+	q = mmap(NULL, TEST_PAGE_SIZE, PROT_READ, MAP_PRIVATE, 0, 0);
+	TEST_EQUAL((int)q, (int)MAP_FAILED, "file mapping did not fail");
+	TEST_EQUAL(errno, ENODEV, "file mapping did not fail with ENODEV");
+
+	TEST_STATS();
+	return 0;
+}